@@ -0,0 +1,449 @@
+/**
+ * adio-bench: microbenchmarks of the SQLite driver.
+ *
+ * Each benchmark runs one kind of operation a number of times, through the
+ * synchronous API, the asynchronous API with callbacks, and the asynchronous
+ * API from a coroutine (``spawn``), against a database file and an in-memory
+ * database. Operations are run one after another, so that each latency is
+ * that of a single operation with nothing else queued.
+ *
+ * Results are written as JSON, with the throughput and latency percentiles
+ * of each benchmark.
+ */
+#include <adio/connection.hpp>
+#include <adio/histogram.hpp>
+#include <adio/sqlite.hpp>
+
+#include <sqlite3.h>
+
+#include <boost/asio/spawn.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace
+{
+
+using clock = std::chrono::steady_clock;
+using connection = adio::sqlite::connection;
+using statement = adio::sqlite::statement;
+
+struct bench_options
+{
+    std::size_t iterations = 2000;
+    std::string filter;
+    std::string dir = ".";
+    std::string output;
+};
+
+/// Rows in the table read by the benchmarks
+constexpr int table_rows = 10000;
+/// Rows read by each range scan
+constexpr int scan_rows = 100;
+/// Rows written by each batched insert
+constexpr int batch_rows = 100;
+
+/// A database to run benchmarks against, with a populated table and the
+/// statements the benchmarks use
+struct fixture
+{
+    adio::io_service ios;
+    connection con{ios};
+    /// Opened and closed by the open benchmark
+    connection scratch{ios};
+    std::string path;
+    adio::sqlite_open_options open_opts;
+    statement point;
+    statement range;
+    statement insert;
+    std::vector<std::tuple<int, std::string>> batch;
+    std::minstd_rand rng{42};
+    int next_id = 0;
+
+    fixture(const std::string& db_path)
+        : path{db_path}
+    {
+        if (path != ":memory:")
+        {
+            std::remove(path.data());
+            open_opts.journal_mode = adio::sqlite_journal_mode::wal;
+            open_opts.synchronous = adio::sqlite_synchronous::normal;
+        }
+        con.open(path, open_opts);
+        con.execute("CREATE TABLE kv (k INTEGER PRIMARY KEY, v TEXT)");
+        con.execute("CREATE TABLE log (n INTEGER, v TEXT)");
+        auto fill = con.prepare("INSERT INTO kv VALUES (?, ?)");
+        std::vector<std::tuple<int, std::string>> rows;
+        for (auto i = 0; i < table_rows; ++i)
+            rows.emplace_back(i, "value " + std::to_string(i));
+        con.execute_batch(fill, rows);
+        point = con.prepare("SELECT v FROM kv WHERE k = ?");
+        range = con.prepare("SELECT k, v FROM kv WHERE k BETWEEN ? AND ?");
+        insert = con.prepare("INSERT INTO log VALUES (?, ?)");
+        for (auto i = 0; i < batch_rows; ++i)
+            batch.emplace_back(i, "logged " + std::to_string(i));
+    }
+
+    ~fixture()
+    {
+        point = statement{};
+        range = statement{};
+        insert = statement{};
+        con.close();
+        if (path != ":memory:")
+        {
+            std::remove(path.data());
+            std::remove((path + "-wal").data());
+            std::remove((path + "-shm").data());
+        }
+    }
+
+    int random_key(int span = 1)
+    {
+        return std::uniform_int_distribution<int>{0, table_rows - span}(rng);
+    }
+    void bind_point()
+    {
+        point.reset();
+        point.bind_all(random_key());
+    }
+    void bind_range()
+    {
+        const auto lo = random_key(scan_rows);
+        range.reset();
+        range.bind_all(lo, lo + scan_rows - 1);
+    }
+    void bind_insert()
+    {
+        insert.reset();
+        insert.bind_all(next_id++, std::string{"logged"});
+    }
+};
+
+/// Report a failed operation and stop
+void check(const adio::error_code& ec, const char* what)
+{
+    if (!ec) return;
+    std::cerr << "adio-bench: " << what << " failed: " << ec.message() << '\n';
+    std::exit(1);
+}
+
+/// A benchmarked operation, in each of the ways it can be run
+struct bench_case
+{
+    const char* name;
+    /// Rows read or written by each operation
+    int rows;
+    std::function<void(fixture&)> sync;
+    /// Start the operation, and call the function when it completes
+    std::function<void(fixture&, std::function<void()>)> async;
+    /// Run the operation from a coroutine. Only operations that complete
+    /// with just an ``error_code`` can be awaited with a ``yield_context``,
+    /// so this is empty for the others.
+    std::function<void(fixture&, adio::asio::yield_context)> spawn;
+};
+
+std::vector<bench_case> bench_cases()
+{
+    using yield = adio::asio::yield_context;
+    using next_fn = std::function<void()>;
+    std::vector<bench_case> ret;
+
+    ret.push_back(
+        {"open",
+         0,
+         [](fixture& f) {
+             check(f.scratch.open(f.path, f.open_opts), "open");
+             f.scratch.close();
+         },
+         [](fixture& f, next_fn next) {
+             f.scratch.async_open(
+                 f.path, f.open_opts, [&f, next](adio::error_code ec) {
+                     check(ec, "open");
+                     f.scratch.close();
+                     next();
+                 });
+         },
+         [](fixture& f, yield yc) {
+             adio::error_code ec;
+             f.scratch.async_open(f.path, f.open_opts, yc[ec]);
+             check(ec, "open");
+             f.scratch.close();
+         }});
+
+    // Compiles the point query. The statement cache is disabled while this
+    // runs, so each prepare compiles the SQL again.
+    ret.push_back(
+        {"prepare",
+         0,
+         [](fixture& f) { f.con.prepare("SELECT v FROM kv WHERE k = ?"); },
+         [](fixture& f, next_fn next) {
+             f.con.async_prepare("SELECT v FROM kv WHERE k = ?",
+                                 [next](statement, adio::error_code ec) {
+                                     check(ec, "prepare");
+                                     next();
+                                 });
+         },
+         nullptr});
+
+    ret.push_back({"point_select",
+                   1,
+                   [](fixture& f) {
+                       f.bind_point();
+                       f.con.step(f.point);
+                   },
+                   [](fixture& f, next_fn next) {
+                       f.bind_point();
+                       f.con.async_step(
+                           f.point,
+                           [next](adio::sqlite::row, adio::error_code ec) {
+                               check(ec, "point select");
+                               next();
+                           });
+                   },
+                   nullptr});
+
+    ret.push_back(
+        {"range_scan",
+         scan_rows,
+         [](fixture& f) {
+             f.bind_range();
+             f.con.step_batch(f.range, scan_rows + 1);
+         },
+         [](fixture& f, next_fn next) {
+             f.bind_range();
+             f.con.async_step_batch(
+                 f.range,
+                 scan_rows + 1,
+                 [next](std::vector<adio::sqlite::row>, adio::error_code ec) {
+                     check(ec, "range scan");
+                     next();
+                 });
+         },
+         nullptr});
+
+    ret.push_back({"insert",
+                   1,
+                   [](fixture& f) {
+                       f.bind_insert();
+                       f.con.execute(f.insert);
+                   },
+                   [](fixture& f, next_fn next) {
+                       f.bind_insert();
+                       f.con.async_execute(f.insert,
+                                           [next](adio::error_code ec) {
+                                               check(ec, "insert");
+                                               next();
+                                           });
+                   },
+                   [](fixture& f, yield yc) {
+                       adio::error_code ec;
+                       f.bind_insert();
+                       f.con.async_execute(f.insert, yc[ec]);
+                       check(ec, "insert");
+                   }});
+
+    ret.push_back(
+        {"batch_insert",
+         batch_rows,
+         [](fixture& f) { f.con.execute_batch(f.insert, f.batch); },
+         [](fixture& f, next_fn next) {
+             f.con.async_execute_batch(
+                 f.insert, f.batch, [next](adio::error_code ec) {
+                     check(ec, "batch insert");
+                     next();
+                 });
+         },
+         [](fixture& f, yield yc) {
+             adio::error_code ec;
+             f.con.async_execute_batch(f.insert, f.batch, yc[ec]);
+             check(ec, "batch insert");
+         }});
+
+    return ret;
+}
+
+struct bench_result
+{
+    std::string name;
+    std::string mode;
+    std::string database;
+    int rows;
+    double seconds;
+    adio::histogram_snapshot latency;
+};
+
+/// Time ``n`` runs of an operation, one after another
+bench_result run_sync(fixture& f, const bench_case& c, std::size_t n)
+{
+    adio::latency_histogram hist;
+    const auto start = clock::now();
+    for (auto i = 0u; i < n; ++i)
+    {
+        const auto op_start = clock::now();
+        c.sync(f);
+        hist.record(clock::now() - op_start);
+    }
+    const auto seconds
+        = std::chrono::duration<double>(clock::now() - start).count();
+    return {c.name, "sync", "", c.rows, seconds, hist.snapshot()};
+}
+
+bench_result run_async(fixture& f, const bench_case& c, std::size_t n)
+{
+    adio::latency_histogram hist;
+    std::size_t remaining = n;
+    clock::time_point op_start;
+    std::function<void()> next = [&] {
+        hist.record(clock::now() - op_start);
+        if (--remaining == 0) return;
+        op_start = clock::now();
+        c.async(f, next);
+    };
+    const auto start = clock::now();
+    op_start = start;
+    c.async(f, next);
+    f.ios.reset();
+    f.ios.run();
+    const auto seconds
+        = std::chrono::duration<double>(clock::now() - start).count();
+    return {c.name, "async", "", c.rows, seconds, hist.snapshot()};
+}
+
+bench_result run_spawn(fixture& f, const bench_case& c, std::size_t n)
+{
+    adio::latency_histogram hist;
+    const auto start = clock::now();
+    adio::asio::spawn(f.ios, [&](adio::asio::yield_context yc) {
+        for (auto i = 0u; i < n; ++i)
+        {
+            const auto op_start = clock::now();
+            c.spawn(f, yc);
+            hist.record(clock::now() - op_start);
+        }
+    });
+    f.ios.reset();
+    f.ios.run();
+    const auto seconds
+        = std::chrono::duration<double>(clock::now() - start).count();
+    return {c.name, "spawn", "", c.rows, seconds, hist.snapshot()};
+}
+
+void write_json(std::ostream& out,
+                const bench_options& opts,
+                const std::vector<bench_result>& results)
+{
+    const auto ns = [](std::chrono::nanoseconds d) { return d.count(); };
+    out << "{\n  \"sqlite_version\": \"" << ::sqlite3_libversion() << "\",\n"
+        << "  \"iterations\": " << opts.iterations << ",\n"
+        << "  \"benchmarks\": [";
+    auto first = true;
+    for (const auto& r : results)
+    {
+        const auto ops = r.latency.count();
+        out << (first ? "\n" : ",\n");
+        first = false;
+        out << "    {\"name\": \"" << r.name << "\", \"mode\": \"" << r.mode
+            << "\", \"database\": \"" << r.database
+            << "\", \"operations\": " << ops
+            << ", \"rows_per_operation\": " << r.rows
+            << ", \"seconds\": " << r.seconds
+            << ", \"operations_per_second\": " << double(ops) / r.seconds
+            << ",\n     \"latency_ns\": {\"mean\": " << ns(r.latency.mean())
+            << ", \"p50\": " << ns(r.latency.percentile(0.5))
+            << ", \"p99\": " << ns(r.latency.percentile(0.99))
+            << ", \"p999\": " << ns(r.latency.percentile(0.999))
+            << ", \"max\": " << ns(r.latency.max()) << "}}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+void usage(const char* argv0)
+{
+    std::cerr
+        << "Usage: " << argv0 << " [options]\n"
+        << "  --iterations N  Operations per benchmark (default 2000)\n"
+        << "  --filter TEXT   Only run benchmarks whose id contains TEXT.\n"
+        << "                  Ids look like point_select/async/memory\n"
+        << "  --dir DIR       Where to create the database file (default .)\n"
+        << "  --output FILE   Write the JSON results to FILE, not stdout\n";
+}
+
+} /* anonymous namespace */
+
+int main(int argc, char** argv)
+{
+    bench_options opts;
+    for (auto i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const auto has_value = i + 1 < argc;
+        if (arg == "--iterations" && has_value)
+            opts.iterations = std::stoul(argv[++i]);
+        else if (arg == "--filter" && has_value)
+            opts.filter = argv[++i];
+        else if (arg == "--dir" && has_value)
+            opts.dir = argv[++i];
+        else if (arg == "--output" && has_value)
+            opts.output = argv[++i];
+        else
+        {
+            usage(argv[0]);
+            return arg == "--help" ? 0 : 2;
+        }
+    }
+    if (opts.iterations == 0) opts.iterations = 1;
+
+    using runner = bench_result (*)(fixture&, const bench_case&, std::size_t);
+    const std::pair<const char*, runner> modes[] = {
+        {"sync", &run_sync},
+        {"async", &run_async},
+        {"spawn", &run_spawn},
+    };
+    const std::pair<const char*, std::string> databases[] = {
+        {"file", opts.dir + "/adio-bench.db"},
+        {"memory", ":memory:"},
+    };
+
+    std::vector<bench_result> results;
+    for (const auto& db : databases)
+    {
+        fixture f{db.second};
+        for (const auto& c : bench_cases())
+        {
+            for (const auto& mode : modes)
+            {
+                const auto id = std::string{c.name} + '/' + mode.first + '/'
+                                + db.first;
+                if (id.find(opts.filter) == std::string::npos) continue;
+                if (mode.second == &run_spawn && !c.spawn) continue;
+                std::cerr << "adio-bench: " << id << '\n';
+                if (std::string{c.name} == "prepare")
+                    f.con.driver().set_statement_cache_capacity(0);
+                // Warm up caches before measuring
+                mode.second(f, c, opts.iterations / 10 + 1);
+                auto r = mode.second(f, c, opts.iterations);
+                f.con.driver().set_statement_cache_capacity(
+                    adio::sqlite::default_statement_cache_capacity);
+                r.database = db.first;
+                results.push_back(std::move(r));
+            }
+        }
+    }
+
+    if (opts.output.empty())
+    {
+        write_json(std::cout, opts, results);
+        return 0;
+    }
+    std::ofstream out{opts.output};
+    write_json(out, opts, results);
+    return out ? 0 : 1;
+}
@@ -0,0 +1,305 @@
+/**
+ * adio-overhead: microbenchmarks of what adio itself costs per operation.
+ *
+ * Operations are run against the mock driver with no service time, so no
+ * time is spent in a database and all that is measured is adio and Asio.
+ * Each layer of the path from a call to its handler is measured on its own,
+ * so that the difference between two benchmarks is the cost of one layer:
+ *
+ *  - ``post``: an empty handler posted to the ``io_service`` and run
+ *  - ``driver_*``: calls on the driver object, which post their handler
+ *    straight to the ``io_service``
+ *  - ``connection_*``: the same calls through ``basic_connection`` and the
+ *    service, which add ``handler_helper`` and ``async_result``
+ *  - ``spawn_*``: the same calls awaited from a coroutine, which adds
+ *    switching to and from the coroutine
+ *
+ * Each benchmark reports the time and the number of heap allocations per
+ * operation, measured over a batch of operations run one after another. The
+ * fastest of several batches is reported, to leave out interruptions.
+ */
+#include <adio/connection.hpp>
+#include <adio/mock.hpp>
+
+#include <boost/asio/spawn.hpp>
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+/// The number of heap allocations made by the program so far
+std::atomic<std::uint64_t> allocations{0};
+
+} /* anonymous namespace */
+
+void* operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+namespace
+{
+
+using clock = std::chrono::steady_clock;
+using connection = adio::mock_driver::connection;
+using statement = adio::mock_driver::statement;
+using yield = adio::asio::yield_context;
+
+struct bench_options
+{
+    std::size_t iterations = 100000;
+    std::size_t rounds = 5;
+    std::string filter;
+    std::string output;
+};
+
+/// A connection to run benchmarks on, with a statement to execute and one
+/// which produces a row every time it is stepped
+struct fixture
+{
+    adio::io_service ios;
+    connection con{ios};
+    statement command;
+    statement query;
+
+    fixture()
+    {
+        adio::mock_options opts;
+        opts.rows = std::numeric_limits<std::size_t>::max();
+        con.driver().set_options(opts);
+        con.open("mock");
+        command = con.prepare("DELETE FROM t");
+        query = con.prepare("SELECT 1");
+    }
+};
+
+/// Start an operation, and call the function when it completes
+using async_fn = std::function<void(fixture&, const std::function<void()>&)>;
+
+/// Run ``n`` calls of a synchronous operation
+std::function<void(fixture&, std::size_t)>
+sync_op(std::function<void(fixture&)> op)
+{
+    return [op](fixture& f, std::size_t n) {
+        for (auto i = 0u; i < n; ++i) op(f);
+    };
+}
+
+/// Run ``n`` asynchronous operations, each started by the handler of the one
+/// before
+std::function<void(fixture&, std::size_t)> async_op(async_fn op)
+{
+    return [op](fixture& f, std::size_t n) {
+        std::function<void()> next = [&] {
+            if (n-- > 0) op(f, next);
+        };
+        next();
+        f.ios.reset();
+        f.ios.run();
+    };
+}
+
+/// Run ``n`` asynchronous operations from a coroutine
+std::function<void(fixture&, std::size_t)>
+spawn_op(std::function<void(fixture&, yield)> op)
+{
+    return [op](fixture& f, std::size_t n) {
+        adio::asio::spawn(f.ios, [&](yield yc) {
+            for (auto i = 0u; i < n; ++i) op(f, yc);
+        });
+        f.ios.reset();
+        f.ios.run();
+    };
+}
+
+struct bench_case
+{
+    const char* name;
+    std::function<void(fixture&, std::size_t)> run;
+};
+
+std::vector<bench_case> bench_cases()
+{
+    using next_fn = std::function<void()>;
+    using adio::error_code;
+    std::vector<bench_case> ret;
+
+    ret.push_back({"post", async_op([](fixture& f, const next_fn& next) {
+                       f.ios.post([&next] { next(); });
+                   })});
+    ret.push_back({"driver_execute", sync_op([](fixture& f) {
+                       f.con.driver().execute(f.command);
+                   })});
+    ret.push_back({"connection_execute",
+                   sync_op([](fixture& f) { f.con.execute(f.command); })});
+    ret.push_back({"driver_step",
+                   sync_op([](fixture& f) { f.con.driver().step(f.query); })});
+    ret.push_back({"connection_step",
+                   sync_op([](fixture& f) { f.con.step(f.query); })});
+
+    ret.push_back({"driver_async_execute",
+                   async_op([](fixture& f, const next_fn& next) {
+                       f.con.driver().async_execute(
+                           f.command, [&next](error_code) { next(); });
+                   })});
+    ret.push_back({"connection_async_execute",
+                   async_op([](fixture& f, const next_fn& next) {
+                       f.con.async_execute(f.command,
+                                           [&next](error_code) { next(); });
+                   })});
+    ret.push_back({"driver_async_step",
+                   async_op([](fixture& f, const next_fn& next) {
+                       f.con.driver().async_step(
+                           f.query, [&next](adio::row, error_code) { next(); });
+                   })});
+    ret.push_back({"connection_async_step",
+                   async_op([](fixture& f, const next_fn& next) {
+                       f.con.async_step(
+                           f.query, [&next](adio::row, error_code) { next(); });
+                   })});
+    ret.push_back({"driver_async_prepare",
+                   async_op([](fixture& f, const next_fn& next) {
+                       f.con.driver().async_prepare(
+                           "SELECT 1",
+                           [&next](statement, error_code) { next(); });
+                   })});
+    ret.push_back({"connection_async_prepare",
+                   async_op([](fixture& f, const next_fn& next) {
+                       f.con.async_prepare(
+                           "SELECT 1",
+                           [&next](statement, error_code) { next(); });
+                   })});
+
+    // Only operations that complete with just an error_code can be awaited
+    // with a yield_context
+    ret.push_back({"spawn_execute", spawn_op([](fixture& f, yield yc) {
+                       f.con.async_execute(f.command, yc);
+                   })});
+    return ret;
+}
+
+struct bench_result
+{
+    std::string name;
+    std::size_t operations;
+    double ns_per_operation;
+    double allocations_per_operation;
+};
+
+bench_result run(fixture& f, const bench_case& c, const bench_options& opts)
+{
+    // Warm up caches and Asio's handler memory before measuring
+    c.run(f, opts.iterations / 10 + 1);
+    bench_result result{c.name, opts.iterations, 0, 0};
+    auto best = std::numeric_limits<double>::max();
+    for (auto i = 0u; i < opts.rounds; ++i)
+    {
+        const auto allocs_before = allocations.load();
+        const auto start = clock::now();
+        c.run(f, opts.iterations);
+        const auto elapsed = clock::now() - start;
+        const auto allocs = allocations.load() - allocs_before;
+        const auto ns
+            = std::chrono::duration<double, std::nano>(elapsed).count()
+              / opts.iterations;
+        if (ns < best)
+        {
+            best = ns;
+            result.allocations_per_operation
+                = double(allocs) / opts.iterations;
+        }
+    }
+    result.ns_per_operation = best;
+    return result;
+}
+
+void write_json(std::ostream& out,
+                const bench_options& opts,
+                const std::vector<bench_result>& results)
+{
+    out << "{\n  \"iterations\": " << opts.iterations << ",\n"
+        << "  \"rounds\": " << opts.rounds << ",\n"
+        << "  \"benchmarks\": [";
+    auto first = true;
+    for (const auto& r : results)
+    {
+        out << (first ? "\n" : ",\n");
+        first = false;
+        out << "    {\"name\": \"" << r.name
+            << "\", \"operations\": " << r.operations
+            << ", \"ns_per_operation\": " << r.ns_per_operation
+            << ", \"allocations_per_operation\": "
+            << r.allocations_per_operation << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+void usage(const char* argv0)
+{
+    std::cerr
+        << "Usage: " << argv0 << " [options]\n"
+        << "  --iterations N  Operations per batch (default 100000)\n"
+        << "  --rounds N      Batches per benchmark (default 5)\n"
+        << "  --filter TEXT   Only run benchmarks whose name contains TEXT\n"
+        << "  --output FILE   Write the JSON results to FILE, not stdout\n";
+}
+
+} /* anonymous namespace */
+
+int main(int argc, char** argv)
+{
+    bench_options opts;
+    for (auto i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const auto has_value = i + 1 < argc;
+        if (arg == "--iterations" && has_value)
+            opts.iterations = std::stoul(argv[++i]);
+        else if (arg == "--rounds" && has_value)
+            opts.rounds = std::stoul(argv[++i]);
+        else if (arg == "--filter" && has_value)
+            opts.filter = argv[++i];
+        else if (arg == "--output" && has_value)
+            opts.output = argv[++i];
+        else
+        {
+            usage(argv[0]);
+            return arg == "--help" ? 0 : 2;
+        }
+    }
+    if (opts.iterations == 0) opts.iterations = 1;
+    if (opts.rounds == 0) opts.rounds = 1;
+
+    std::vector<bench_result> results;
+    fixture f;
+    for (const auto& c : bench_cases())
+    {
+        if (std::string{c.name}.find(opts.filter) == std::string::npos)
+            continue;
+        std::cerr << "adio-overhead: " << c.name << '\n';
+        results.push_back(run(f, c, opts));
+    }
+
+    if (opts.output.empty())
+    {
+        write_json(std::cout, opts, results);
+        return 0;
+    }
+    std::ofstream out{opts.output};
+    write_json(out, opts, results);
+    return out ? 0 : 1;
+}
@@ -45,6 +45,15 @@ public:
     {
     }
 
+    /** Access the underlying driver object.
+     *
+     * Use this to reach functionality that is specific to a driver and has no
+     * counterpart on other drivers, such as configuration and statistics.
+     */
+    Driver& driver() { return *this->get_implementation(); }
+    /// @copydoc driver()
+    const Driver& driver() const { return *this->get_implementation(); }
+
 #define ADIO_CON_DECL_FN(name)                                                 \
     template <typename... Args>                                                \
     ADIO_DOC_IMPLDEF(auto)                                                     \
@@ -73,6 +82,10 @@ public:
     ADIO_CON_DECL_FN(execute);
     ADIO_CON_DECL_FN(step);
     ADIO_CON_DECL_FN(close);
+    ADIO_CON_DECL_FN(execute_batch);
+    ADIO_CON_DECL_FN(step_batch);
+    ADIO_CON_DECL_FN(begin);
+    ADIO_CON_DECL_FN(backup);
 #undef ADIO_CON_DECL_FN
 };
 
@@ -0,0 +1,386 @@
+#ifndef ADIO_CONNECTION_POOL_HPP_INCLUDED
+#define ADIO_CONNECTION_POOL_HPP_INCLUDED
+
+#include "config.hpp"
+#include "connection.hpp"
+#include "traits.hpp"
+#include "utils.hpp"
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <tuple>
+
+namespace adio
+{
+
+/// Sizing and reaping parameters for a ``connection_pool``
+struct pool_options
+{
+    /// The pool will not reap idle connections below this many. This many
+    /// connections are opened when the pool is constructed.
+    std::size_t min_size = 0;
+    /// The maximum number of connections, open or opening, at one time.
+    /// Acquires beyond this wait for a connection to be returned.
+    std::size_t max_size = 8;
+    /// Connections sitting idle for longer than this are closed the next time
+    /// the pool reaps. The pool runs no timer of its own: see
+    /// ``connection_pool``.
+    std::chrono::steady_clock::duration idle_timeout = std::chrono::minutes{5};
+};
+
+namespace detail
+{
+
+template <typename Driver>
+class pool_state : public std::enable_shared_from_this<pool_state<Driver>>
+{
+public:
+    using connection = basic_connection<Driver>;
+    using connection_ptr = std::shared_ptr<connection>;
+    using clock = std::chrono::steady_clock;
+    using waiter = std::function<void(connection_ptr, error_code)>;
+    using opener
+        = std::function<void(connection&, std::function<void(error_code)>)>;
+
+private:
+    struct idle_entry
+    {
+        connection_ptr con;
+        clock::time_point since;
+    };
+
+    std::mutex _mutex;
+    // Most recently returned connections are at the back. Reaping looks at
+    // the front.
+    std::deque<idle_entry> _idle;
+    std::deque<waiter> _waiters;
+    // Number of connections that are open or being opened
+    std::size_t _size = 0;
+    bool _closed = false;
+
+    void _reap(std::unique_lock<std::mutex>&)
+    {
+        const auto cutoff = clock::now() - options.idle_timeout;
+        while (!_idle.empty() && _size > options.min_size
+               && _idle.front().since < cutoff)
+        {
+            _idle.pop_front();
+            --_size;
+        }
+    }
+
+    void _open_for(waiter w)
+    {
+        auto con = std::make_shared<connection>(ios);
+        auto self = this->shared_from_this();
+        open(*con, [self, con, w](error_code ec) {
+            self->_opened(con, ec, w);
+        });
+    }
+
+    void _opened(connection_ptr con, error_code ec, waiter w)
+    {
+        if (!ec)
+        {
+            if (w)
+                w(std::move(con), ec);
+            else
+                release(std::move(con));
+            return;
+        }
+        std::unique_lock<std::mutex> lk{_mutex};
+        --_size;
+        if (w)
+        {
+            lk.unlock();
+            w(nullptr, ec);
+            return;
+        }
+        // A warm-up connection failed to open. If anyone was waiting on it,
+        // make another attempt on their behalf.
+        if (_waiters.empty() || _closed) return;
+        auto next = std::move(_waiters.front());
+        _waiters.pop_front();
+        ++_size;
+        lk.unlock();
+        _open_for(std::move(next));
+    }
+
+public:
+    pool_state(io_service& ios_, pool_options opts, opener op)
+        : ios(ios_)
+        , options(opts)
+        , open(std::move(op))
+    {
+    }
+
+    io_service& ios;
+    const pool_options options;
+    const opener open;
+
+    void warm_up()
+    {
+        std::unique_lock<std::mutex> lk{_mutex};
+        const auto n = options.min_size > _size ? options.min_size - _size : 0;
+        _size += n;
+        lk.unlock();
+        for (auto i = 0u; i < n; ++i) _open_for(nullptr);
+    }
+
+    void acquire(waiter w)
+    {
+        std::unique_lock<std::mutex> lk{_mutex};
+        if (_closed)
+        {
+            lk.unlock();
+            w(nullptr, asio::error::operation_aborted);
+            return;
+        }
+        if (!_idle.empty())
+        {
+            auto con = std::move(_idle.back().con);
+            _idle.pop_back();
+            lk.unlock();
+            w(std::move(con), error_code{});
+            return;
+        }
+        if (_size < options.max_size)
+        {
+            ++_size;
+            lk.unlock();
+            _open_for(std::move(w));
+            return;
+        }
+        _waiters.push_back(std::move(w));
+    }
+
+    void release(connection_ptr con)
+    {
+        std::unique_lock<std::mutex> lk{_mutex};
+        if (_closed)
+        {
+            --_size;
+            return;
+        }
+        if (!_waiters.empty())
+        {
+            auto w = std::move(_waiters.front());
+            _waiters.pop_front();
+            lk.unlock();
+            w(std::move(con), error_code{});
+            return;
+        }
+        _idle.push_back(idle_entry{std::move(con), clock::now()});
+        _reap(lk);
+    }
+
+    void discard()
+    {
+        std::unique_lock<std::mutex> lk{_mutex};
+        --_size;
+        if (_waiters.empty() || _closed) return;
+        // Replace the discarded connection for the next waiter
+        auto next = std::move(_waiters.front());
+        _waiters.pop_front();
+        ++_size;
+        lk.unlock();
+        _open_for(std::move(next));
+    }
+
+    void reap()
+    {
+        std::unique_lock<std::mutex> lk{_mutex};
+        _reap(lk);
+    }
+
+    void close()
+    {
+        std::unique_lock<std::mutex> lk{_mutex};
+        _closed = true;
+        _size -= _idle.size();
+        _idle.clear();
+        auto waiters = std::move(_waiters);
+        _waiters.clear();
+        lk.unlock();
+        for (auto& w : waiters) w(nullptr, asio::error::operation_aborted);
+    }
+
+    std::size_t size()
+    {
+        std::lock_guard<std::mutex> lk{_mutex};
+        return _size;
+    }
+
+    std::size_t idle_count()
+    {
+        std::lock_guard<std::mutex> lk{_mutex};
+        return _idle.size();
+    }
+};
+
+template <typename Connection, typename Tuple, std::size_t... Is>
+void pool_open(Connection& con,
+               const Tuple& args,
+               seq<Is...>,
+               std::function<void(error_code)> done)
+{
+    con.async_open(std::get<Is>(args)..., std::move(done));
+}
+
+} /* detail */
+
+/** A pool of open database connections.
+ *
+ * @param Driver The database driver, such as ``adio::sqlite``. The driver's
+ * ``async_open`` must complete with a single ``error_code``.
+ *
+ * Connections are handed out through ``async_acquire`` as a ``lease``, which
+ * returns the connection to the pool when it is destroyed. Acquiring an idle
+ * connection does not reopen it: connections are only opened when the pool
+ * needs to grow, up to ``pool_options::max_size``. When the pool is at its
+ * limit, acquires wait in FIFO order for a connection to be returned.
+ *
+ * Idle connections are reaped when connections are returned to the pool, or
+ * when ``reap()`` is called. No timer is kept running by the pool, so it does
+ * not keep ``io_service::run()`` from returning. A pool that may sit unused
+ * for longer than ``pool_options::idle_timeout`` only closes its idle
+ * connections if the application calls ``reap()`` periodically, for example
+ * from its own ``steady_timer``.
+ */
+template <typename Driver> class connection_pool
+{
+public:
+    using connection = basic_connection<Driver>;
+
+private:
+    using state_type = detail::pool_state<Driver>;
+    std::shared_ptr<state_type> _state;
+
+public:
+    /** An exclusive handle to a connection from the pool.
+     *
+     * Returns the connection to the pool when destroyed. If the connection is
+     * found to be broken, call ``discard()`` to close it instead.
+     */
+    class lease
+    {
+        std::shared_ptr<state_type> _state;
+        std::shared_ptr<connection> _con;
+
+    public:
+        lease() = default;
+        lease(std::shared_ptr<state_type> st, std::shared_ptr<connection> con)
+            : _state{std::move(st)}
+            , _con{std::move(con)}
+        {
+        }
+        lease(lease&&) = default;
+        lease& operator=(lease&& other)
+        {
+            release();
+            _state = std::move(other._state);
+            _con = std::move(other._con);
+            return *this;
+        }
+        lease(const lease&) = delete;
+        lease& operator=(const lease&) = delete;
+        ~lease() { release(); }
+
+        /// Return the connection to the pool early
+        void release()
+        {
+            if (_con) _state->release(std::move(_con));
+            _con = nullptr;
+        }
+
+        /// Close the connection instead of returning it to the pool
+        void discard()
+        {
+            if (_con) _state->discard();
+            _con = nullptr;
+        }
+
+        connection& operator*() const { return *_con; }
+        connection* operator->() const { return _con.get(); }
+        explicit operator bool() const { return !!_con; }
+    };
+
+    using acquire_handler_signature = void(lease, error_code);
+
+    /** Create a new connection pool.
+     *
+     * @param ios The ``io_service`` for the pool's connections and handlers
+     * @param opts Sizing options for the pool
+     * @param open_args The arguments given to ``async_open`` on each new
+     * connection (eg. a database path)
+     */
+    template <typename... OpenArgs>
+    connection_pool(io_service& ios, pool_options opts, OpenArgs&&... open_args)
+    {
+        auto args = std::make_tuple(std::forward<OpenArgs>(open_args)...);
+        typename state_type::opener op = [args](
+            connection& con, std::function<void(error_code)> done) {
+            detail::pool_open(con,
+                              args,
+                              detail::gen_seq<sizeof...(OpenArgs)>{},
+                              std::move(done));
+        };
+        _state = std::make_shared<state_type>(ios, opts, std::move(op));
+        _state->warm_up();
+    }
+
+    connection_pool(const connection_pool&) = delete;
+    connection_pool& operator=(const connection_pool&) = delete;
+
+    /// Destroys the pool. Pending acquires complete with
+    /// ``operation_aborted``, and outstanding leases close their connection
+    /// when they are released.
+    ~connection_pool() { _state->close(); }
+
+    /** Asynchronously acquire a connection from the pool.
+     *
+     * The handler is invoked with a ``lease`` on an open connection, or an
+     * empty ``lease`` and the error from opening a new connection.
+     */
+    template <typename Handler>
+    auto async_acquire(Handler&& handler) -> decltype(
+        std::declval<handler_helper<acquire_handler_signature,
+                                    handler_decay<Handler>>&>()
+            .result.get())
+    {
+        handler_helper<acquire_handler_signature, handler_decay<Handler>> init{
+            std::forward<Handler>(handler)};
+        auto real_handler = init.handler;
+        auto state = _state;
+        _state->acquire([state, real_handler](
+            std::shared_ptr<connection> con, error_code ec) {
+            // Form the lease before posting, so that the connection goes
+            // back to the pool even if the handler is destroyed without
+            // running (eg. because the io_service is stopped)
+            auto l = std::make_shared<lease>(state, std::move(con));
+            state->ios.post([l, ec, real_handler]() mutable {
+                real_handler(std::move(*l), ec);
+            });
+        });
+        return init.result.get();
+    }
+
+    /// Close connections that have been idle for longer than
+    /// ``pool_options::idle_timeout``, keeping at least ``min_size`` open.
+    /// This is the only way idle connections are closed while none are
+    /// being returned.
+    void reap() { _state->reap(); }
+
+    /// The number of connections which are open or opening
+    std::size_t size() const { return _state->size(); }
+    /// The number of open connections not currently leased
+    std::size_t idle_count() const { return _state->idle_count(); }
+    const pool_options& options() const { return _state->options; }
+};
+
+} /* adio */
+
+#endif  // ADIO_CONNECTION_POOL_HPP_INCLUDED
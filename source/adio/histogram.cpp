@@ -0,0 +1,122 @@
+#include "histogram.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace adio;
+
+constexpr unsigned latency_histogram::sub_bucket_bits;
+constexpr std::size_t latency_histogram::sub_bucket_count;
+constexpr std::size_t latency_histogram::bucket_count;
+
+namespace
+{
+
+/// Get the position of the highest set bit of a non-zero value
+unsigned highest_bit(std::uint64_t value)
+{
+#if defined(__GNUC__)
+    return 63 - unsigned(__builtin_clzll(value));
+#else
+    unsigned ret = 0;
+    while (value >>= 1) ++ret;
+    return ret;
+#endif
+}
+
+} /* anonymous namespace */
+
+std::size_t latency_histogram::bucket_for(std::uint64_t value)
+{
+    if (value < (std::uint64_t(1) << sub_bucket_bits))
+        return std::size_t(value);
+    // Keep the top sub_bucket_bits bits of the value. The bucket is found by
+    // how far they had to be shifted down, and what is left of them.
+    const auto shift = highest_bit(value) - (sub_bucket_bits - 1);
+    return sub_bucket_count * shift + std::size_t(value >> shift);
+}
+
+std::uint64_t latency_histogram::bucket_lowest(std::size_t index)
+{
+    if (index < (std::size_t(1) << sub_bucket_bits)) return index;
+    const auto shift = index / sub_bucket_count - 1;
+    return std::uint64_t(index - sub_bucket_count * shift) << shift;
+}
+
+std::uint64_t latency_histogram::bucket_highest(std::size_t index)
+{
+    if (index < (std::size_t(1) << sub_bucket_bits)) return index;
+    const auto shift = index / sub_bucket_count - 1;
+    return bucket_lowest(index) + ((std::uint64_t(1) << shift) - 1);
+}
+
+void latency_histogram::record(std::chrono::nanoseconds value)
+{
+    const std::uint64_t v = value.count() > 0 ? value.count() : 0;
+    _counts[bucket_for(v)].fetch_add(1, std::memory_order_relaxed);
+    _sum.fetch_add(v, std::memory_order_relaxed);
+    auto max = _max.load(std::memory_order_relaxed);
+    while (v > max
+           && !_max.compare_exchange_weak(max, v, std::memory_order_relaxed))
+    {
+    }
+}
+
+histogram_snapshot latency_histogram::snapshot() const
+{
+    histogram_snapshot ret;
+    ret._counts.resize(bucket_count);
+    for (auto i = 0u; i < bucket_count; ++i)
+    {
+        ret._counts[i] = _counts[i].load(std::memory_order_relaxed);
+        ret._count += ret._counts[i];
+    }
+    ret._sum = std::chrono::nanoseconds{
+        std::int64_t(_sum.load(std::memory_order_relaxed))};
+    ret._max = std::chrono::nanoseconds{
+        std::int64_t(_max.load(std::memory_order_relaxed))};
+    return ret;
+}
+
+void latency_histogram::reset()
+{
+    for (auto& c : _counts) c.store(0, std::memory_order_relaxed);
+    _sum.store(0, std::memory_order_relaxed);
+    _max.store(0, std::memory_order_relaxed);
+}
+
+std::chrono::nanoseconds histogram_snapshot::percentile(double q) const
+{
+    if (_count == 0) return std::chrono::nanoseconds{0};
+    q = std::min(std::max(q, 0.0), 1.0);
+    const auto rank = std::max(std::uint64_t(1),
+                               std::uint64_t(std::ceil(q * double(_count))));
+    // The largest value is known exactly
+    if (rank >= _count) return _max;
+    std::uint64_t seen = 0;
+    for (auto i = 0u; i < _counts.size(); ++i)
+    {
+        seen += _counts[i];
+        if (seen < rank) continue;
+        // Report the middle of the bucket, which is never more than half a
+        // bucket away from the real value
+        const auto lo = latency_histogram::bucket_lowest(i);
+        const auto hi = latency_histogram::bucket_highest(i);
+        const auto mid = std::int64_t(lo + (hi - lo) / 2);
+        return std::min(std::chrono::nanoseconds{mid}, _max);
+    }
+    return _max;
+}
+
+histogram_snapshot& histogram_snapshot::
+operator+=(const histogram_snapshot& other)
+{
+    if (_counts.size() < other._counts.size())
+        _counts.resize(other._counts.size());
+    for (auto i = 0u; i < other._counts.size(); ++i)
+        _counts[i] += other._counts[i];
+    _count += other._count;
+    _sum += other._sum;
+    _max = std::max(_max, other._max);
+    return *this;
+}
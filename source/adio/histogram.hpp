@@ -0,0 +1,98 @@
+#ifndef ADIO_HISTOGRAM_HPP_INCLUDED
+#define ADIO_HISTOGRAM_HPP_INCLUDED
+
+#include "config.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace adio
+{
+
+class latency_histogram;
+
+/// The recorded values of a ``latency_histogram`` at one point in time
+class histogram_snapshot
+{
+    friend class latency_histogram;
+
+    std::vector<std::uint64_t> _counts;
+    std::uint64_t _count = 0;
+    std::chrono::nanoseconds _sum{0};
+    std::chrono::nanoseconds _max{0};
+
+public:
+    /// The number of values recorded
+    std::uint64_t count() const { return _count; }
+    /// The total of all values recorded
+    std::chrono::nanoseconds sum() const { return _sum; }
+    /// The largest value recorded, exactly
+    std::chrono::nanoseconds max() const { return _max; }
+    std::chrono::nanoseconds mean() const
+    {
+        if (_count == 0) return std::chrono::nanoseconds{0};
+        return _sum / static_cast<std::int64_t>(_count);
+    }
+
+    /** Get the value below which a fraction ``q`` of the values fall.
+     *
+     * ``q`` is between zero and one, so ``percentile(0.99)`` is the 99th
+     * percentile. The result is accurate to within the width of a bucket,
+     * about 3% of the value. Returns zero if nothing was recorded.
+     */
+    std::chrono::nanoseconds percentile(double q) const;
+
+    /// Add the values of another snapshot to this one
+    histogram_snapshot& operator+=(const histogram_snapshot& other);
+};
+
+/**
+ * A histogram of durations, in the style of HdrHistogram.
+ *
+ * Values are counted in buckets whose width grows with the magnitude of the
+ * value, so that every value is kept to five significant bits (about 3%),
+ * from nanoseconds up to centuries, in a fixed amount of memory. Recording a
+ * value is lock-free and may happen on several threads at once.
+ */
+class latency_histogram
+{
+public:
+    /// Values are exact below ``2 ^ sub_bucket_bits`` nanoseconds, and
+    /// ``2 ^ (sub_bucket_bits - 1)`` buckets cover each power of two above.
+    static constexpr unsigned sub_bucket_bits = 5;
+    static constexpr std::size_t sub_bucket_count = std::size_t(1)
+                                                    << (sub_bucket_bits - 1);
+    static constexpr std::size_t bucket_count
+        = sub_bucket_count * (64 - sub_bucket_bits + 2);
+
+    /// Get the index of the bucket that holds ``value``
+    static std::size_t bucket_for(std::uint64_t value);
+    /// Get the smallest value held by a bucket
+    static std::uint64_t bucket_lowest(std::size_t index);
+    /// Get the largest value held by a bucket
+    static std::uint64_t bucket_highest(std::size_t index);
+
+private:
+    std::array<std::atomic<std::uint64_t>, bucket_count> _counts{};
+    std::atomic<std::uint64_t> _sum{0};
+    std::atomic<std::uint64_t> _max{0};
+
+public:
+    latency_histogram() = default;
+    latency_histogram(const latency_histogram&) = delete;
+    latency_histogram& operator=(const latency_histogram&) = delete;
+
+    /// Record a value. Negative values are recorded as zero.
+    void record(std::chrono::nanoseconds value);
+    histogram_snapshot snapshot() const;
+    /// Discard all recorded values. Values recorded at the same time on other
+    /// threads may be partly kept.
+    void reset();
+};
+
+} /* adio */
+
+#endif  // ADIO_HISTOGRAM_HPP_INCLUDED
@@ -37,8 +37,10 @@ public:
 
 #define ADIO_SERVICE_DECL_FN(name, ...)                                        \
 public:                                                                        \
-    template <typename... Args>                                                \
-    auto name(implementation_type& impl, Args&&... args)                       \
+    /* The implementation type is a template parameter so that drivers         \
+     * which lack this operation remove it by SFINAE */                        \
+    template <typename Impl = implementation_type, typename... Args>           \
+    auto name(Impl& impl, Args&&... args)                                      \
         ->decltype(impl->name(std::forward<Args>(args)...))                    \
     {                                                                          \
         return impl->name(std::forward<Args>(args)...);                        \
@@ -107,6 +109,10 @@ public:                                                                        \
     ADIO_SERVICE_DECL_FN(execute);
     ADIO_SERVICE_DECL_FN(step);
     ADIO_SERVICE_DECL_FN(close);
+    ADIO_SERVICE_DECL_FN(execute_batch);
+    ADIO_SERVICE_DECL_FN(step_batch);
+    ADIO_SERVICE_DECL_FN(begin);
+    ADIO_SERVICE_DECL_FN(backup);
 
 private:
     void shutdown_service() override{};
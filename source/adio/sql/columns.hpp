@@ -0,0 +1,180 @@
+#ifndef ADIO_COLUMNS_HPP_INCLUDED
+#define ADIO_COLUMNS_HPP_INCLUDED
+
+#include "value.hpp"
+#include "view.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace adio
+{
+
+/**
+ * The values of a single result column, stored contiguously.
+ *
+ * A column stores its values in one of three layouts, chosen by the type of
+ * the first non-NULL value placed in it (see ``type()``):
+ *
+ * - ``type::integer`` values are stored in ``integers``
+ * - ``type::real`` values are stored in ``reals``
+ * - ``type::text`` and ``type::blob`` values are stored back-to-back in
+ *   ``bytes``. The value of row ``n`` spans ``offsets[n]`` to
+ *   ``offsets[n + 1]``.
+ *
+ * NULL rows hold a zero or empty placeholder in the storage, and have their
+ * bit cleared in the ``validity`` bitmap. Until the first non-NULL value, the
+ * type is ``type::null_t`` and no storage is used.
+ */
+class column_buffer
+{
+    adio::type _type = adio::type::null_t;
+    std::size_t _size = 0;
+
+    void _set_valid(bool valid)
+    {
+        if (_size % 8 == 0) validity.push_back(0);
+        if (valid) validity.back() |= std::uint8_t(1u << (_size % 8));
+    }
+
+    void _push_placeholder()
+    {
+        switch (_type)
+        {
+        case adio::type::integer:
+            integers.push_back(0);
+            break;
+        case adio::type::real:
+            reals.push_back(0);
+            break;
+        case adio::type::text:
+        case adio::type::blob:
+            offsets.push_back(bytes.size());
+            break;
+        default:
+            break;
+        }
+    }
+
+    void _set_type(adio::type t)
+    {
+        if (_type != adio::type::null_t) return;
+        _type = t;
+        // Back-fill placeholders for the NULLs we have seen so far
+        if (t == adio::type::text || t == adio::type::blob)
+            offsets.assign(1, 0);
+        for (auto i = 0u; i < _size; ++i) _push_placeholder();
+    }
+
+public:
+    /// The column name
+    std::string name;
+    std::vector<value::integer> integers;
+    std::vector<value::real> reals;
+    std::vector<std::size_t> offsets;
+    std::vector<char> bytes;
+    /// One bit per row, least significant bit first. Set for non-NULL rows.
+    std::vector<std::uint8_t> validity;
+
+    /// The type that determines the layout of this column
+    adio::type type() const { return _type; }
+    /// The number of rows in the column
+    std::size_t size() const { return _size; }
+    bool is_null(std::size_t n) const
+    {
+        return !(validity[n / 8] & (1u << (n % 8)));
+    }
+
+    string_view text(std::size_t n) const
+    {
+        return {bytes.data() + offsets[n], offsets[n + 1] - offsets[n]};
+    }
+    blob_view blob(std::size_t n) const
+    {
+        return {bytes.data() + offsets[n], offsets[n + 1] - offsets[n]};
+    }
+
+    void clear()
+    {
+        _type = adio::type::null_t;
+        _size = 0;
+        integers.clear();
+        reals.clear();
+        offsets.clear();
+        bytes.clear();
+        validity.clear();
+    }
+
+    void reserve(std::size_t rows)
+    {
+        validity.reserve((rows + 7) / 8);
+        switch (_type)
+        {
+        case adio::type::integer:
+            integers.reserve(rows);
+            break;
+        case adio::type::real:
+            reals.reserve(rows);
+            break;
+        case adio::type::text:
+        case adio::type::blob:
+            offsets.reserve(rows + 1);
+            break;
+        default:
+            break;
+        }
+    }
+
+    void push_null()
+    {
+        _push_placeholder();
+        _set_valid(false);
+        ++_size;
+    }
+    /// Append an integer. Only valid if ``type()`` is ``integer`` or
+    /// ``null_t``.
+    void push_integer(value::integer i)
+    {
+        _set_type(adio::type::integer);
+        integers.push_back(i);
+        _set_valid(true);
+        ++_size;
+    }
+    /// Append a real. Only valid if ``type()`` is ``real`` or ``null_t``.
+    void push_real(value::real r)
+    {
+        _set_type(adio::type::real);
+        reals.push_back(r);
+        _set_valid(true);
+        ++_size;
+    }
+    /// Append text or blob data. Only valid if ``type()`` is ``null_t`` or
+    /// ``t``.
+    void push_bytes(adio::type t, const char* data, std::size_t len)
+    {
+        _set_type(t);
+        bytes.insert(bytes.end(), data, data + len);
+        offsets.push_back(bytes.size());
+        _set_valid(true);
+        ++_size;
+    }
+};
+
+/// A block of result rows, stored column by column
+struct column_batch
+{
+    std::vector<column_buffer> columns;
+    /// The number of rows in the batch
+    std::size_t rows = 0;
+
+    void clear()
+    {
+        for (auto& col : columns) col.clear();
+        rows = 0;
+    }
+};
+
+} /* adio */
+
+#endif  // ADIO_COLUMNS_HPP_INCLUDED
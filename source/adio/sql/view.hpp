@@ -0,0 +1,47 @@
+#ifndef ADIO_VIEW_HPP_INCLUDED
+#define ADIO_VIEW_HPP_INCLUDED
+
+#include <cstddef>
+
+#include <boost/utility/string_ref.hpp>
+
+namespace adio
+{
+
+/// A non-owning reference to a string of text
+using string_view = boost::string_ref;
+
+/// A non-owning reference to a sequence of bytes
+class blob_view
+{
+    const char* _data = nullptr;
+    std::size_t _size = 0;
+
+public:
+    using value_type = char;
+    using const_iterator = const char*;
+    using iterator = const_iterator;
+
+    blob_view() = default;
+    blob_view(const void* data, std::size_t size)
+        : _data{static_cast<const char*>(data)}
+        , _size{size}
+    {
+    }
+    template <typename Container>
+    blob_view(const Container& c)
+        : blob_view(c.data(), c.size())
+    {
+    }
+
+    const char* data() const { return _data; }
+    std::size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+    const_iterator begin() const { return _data; }
+    const_iterator end() const { return _data + _size; }
+    char operator[](std::size_t n) const { return _data[n]; }
+};
+
+} /* adio */
+
+#endif  // ADIO_VIEW_HPP_INCLUDED
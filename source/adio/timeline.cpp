@@ -0,0 +1,151 @@
+#include "timeline.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <ostream>
+
+using namespace adio;
+
+timeline::timeline(std::size_t capacity)
+    : _capacity{capacity}
+{
+}
+
+void timeline::record(timeline_span span)
+{
+    std::lock_guard<std::mutex> lk{_mutex};
+    if (_spans.size() >= _capacity)
+    {
+        ++_dropped;
+        return;
+    }
+    _spans.push_back(std::move(span));
+}
+
+std::vector<timeline_span> timeline::spans() const
+{
+    std::lock_guard<std::mutex> lk{_mutex};
+    return _spans;
+}
+
+std::uint64_t timeline::dropped() const
+{
+    std::lock_guard<std::mutex> lk{_mutex};
+    return _dropped;
+}
+
+void timeline::clear()
+{
+    std::lock_guard<std::mutex> lk{_mutex};
+    _spans.clear();
+    _dropped = 0;
+}
+
+std::uint64_t timeline::this_thread_id()
+{
+    static std::atomic<std::uint64_t> next{1};
+    static thread_local const std::uint64_t id = next++;
+    return id;
+}
+
+namespace
+{
+
+void write_json_string(std::ostream& out, const string& str)
+{
+    out << '"';
+    for (const auto c : str)
+    {
+        switch (c)
+        {
+        case '"':
+            out << "\\\"";
+            break;
+        case '\\':
+            out << "\\\\";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20)
+            {
+                char buf[8];
+                std::snprintf(buf, sizeof buf, "\\u%04x", unsigned(c));
+                out << buf;
+            }
+            else
+            {
+                out << c;
+            }
+        }
+    }
+    out << '"';
+}
+
+} /* anonymous namespace */
+
+void timeline::write_chrome_json(std::ostream& out) const
+{
+    auto spans = this->spans();
+    std::stable_sort(spans.begin(),
+                     spans.end(),
+                     [](const timeline_span& a, const timeline_span& b) {
+                         return a.start < b.start;
+                     });
+    const auto micros = [this](clock::time_point t) {
+        return std::chrono::duration<double, std::micro>(t - _origin).count();
+    };
+    // The last thread span of each operation, which ends its flow
+    std::map<std::uint64_t, const timeline_span*> last;
+    for (const auto& span : spans)
+    {
+        if (span.thread && span.id) last[span.id] = &span;
+    }
+    std::map<std::uint64_t, bool> flow_started;
+
+    const auto flags = out.flags();
+    const auto precision = out.precision();
+    out.setf(std::ios::fixed, std::ios::floatfield);
+    out.precision(3);
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    auto first = true;
+    const auto begin_event = [&](const string& name, const char* ph) {
+        out << (first ? "\n" : ",\n") << "{\"name\":";
+        first = false;
+        write_json_string(out, name);
+        out << ",\"cat\":\"adio\",\"ph\":\"" << ph << "\",\"pid\":1";
+    };
+    for (const auto& span : spans)
+    {
+        if (!span.thread)
+        {
+            // Asynchronous slices are matched up by their ID
+            begin_event(span.name, "b");
+            out << ",\"tid\":0,\"id\":" << span.id
+                << ",\"ts\":" << micros(span.start) << '}';
+            begin_event(span.name, "e");
+            out << ",\"tid\":0,\"id\":" << span.id
+                << ",\"ts\":" << micros(span.end) << '}';
+            continue;
+        }
+        begin_event(span.name, "X");
+        out << ",\"tid\":" << span.thread << ",\"ts\":" << micros(span.start)
+            << ",\"dur\":" << micros(span.end) - micros(span.start)
+            << ",\"args\":{\"id\":" << span.id << "}}";
+        if (!span.id || (last[span.id] == &span && !flow_started[span.id]))
+            continue;
+        // Flow events bind to the slice that encloses them on their thread
+        const auto ph = !flow_started[span.id]
+                            ? "s"
+                            : last[span.id] == &span ? "f" : "t";
+        flow_started[span.id] = true;
+        // All the flow events of an operation must have the same name
+        begin_event("operation", ph);
+        out << ",\"tid\":" << span.thread << ",\"id\":" << span.id
+            << ",\"ts\":" << micros(span.start);
+        if (*ph == 'f') out << ",\"bp\":\"e\"";
+        out << '}';
+    }
+    out << "\n]}\n";
+    out.flags(flags);
+    out.precision(precision);
+}
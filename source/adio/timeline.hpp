@@ -0,0 +1,80 @@
+#ifndef ADIO_TIMELINE_HPP_INCLUDED
+#define ADIO_TIMELINE_HPP_INCLUDED
+
+#include "config.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <mutex>
+#include <vector>
+
+namespace adio
+{
+
+/// A span of time recorded on a ``timeline``
+struct timeline_span
+{
+    using clock = std::chrono::steady_clock;
+
+    string name;
+    /// The correlation ID of the operation the span belongs to. Spans of the
+    /// same operation share an ID.
+    std::uint64_t id = 0;
+    /// The thread the span ran on, from ``timeline::this_thread_id()``. Zero
+    /// for time not spent on any one thread, such as waiting in a queue.
+    std::uint64_t thread = 0;
+    clock::time_point start;
+    clock::time_point end;
+};
+
+/**
+ * A recorder of timed spans, which can be written out as a Chrome trace.
+ *
+ * The trace can be opened in ``chrome://tracing`` or the Perfetto UI. Spans
+ * on a thread are drawn on that thread's track, and the spans of each
+ * operation are connected by flow arrows in the order they started. Spans
+ * that aren't on a thread are drawn as asynchronous slices, grouped by
+ * operation.
+ *
+ * Spans may be recorded from several threads at once. Once ``capacity()``
+ * spans have been recorded, further spans are counted and dropped.
+ */
+class timeline
+{
+public:
+    using clock = timeline_span::clock;
+
+private:
+    mutable std::mutex _mutex;
+    std::vector<timeline_span> _spans;
+    std::size_t _capacity;
+    std::uint64_t _dropped = 0;
+    std::atomic<std::uint64_t> _next_id{1};
+    const clock::time_point _origin = clock::now();
+
+public:
+    explicit timeline(std::size_t capacity = 1 << 20);
+
+    /// Get a new correlation ID
+    std::uint64_t new_id() { return _next_id++; }
+    void record(timeline_span span);
+
+    std::vector<timeline_span> spans() const;
+    /// The number of spans dropped because the timeline was full
+    std::uint64_t dropped() const;
+    std::size_t capacity() const { return _capacity; }
+    void clear();
+
+    /// Write the spans in the Chrome trace event JSON format. Times are in
+    /// microseconds since the timeline was created.
+    void write_chrome_json(std::ostream& out) const;
+
+    /// Get a small number identifying the calling thread, starting from one
+    static std::uint64_t this_thread_id();
+};
+
+} /* adio */
+
+#endif  // ADIO_TIMELINE_HPP_INCLUDED
@@ -27,6 +27,11 @@ inline void throw_if_error(const error_code& e, const string& what)
 {
     if (e) throw system_error{e, what};
 }
+/// Avoids building a string for the message unless there is an error
+inline void throw_if_error(const error_code& e, const char* what)
+{
+    if (e) throw system_error{e, what};
+}
 
 using std::begin;
 using std::end;
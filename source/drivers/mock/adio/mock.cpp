@@ -0,0 +1,96 @@
+#include "mock.hpp"
+
+#include <algorithm>
+#include <thread>
+
+namespace adio
+{
+
+mock_driver::mock_driver(mock_service& service)
+    : _parent_ios{service.get_io_service()}
+    , _rng{_opts.seed}
+{
+}
+
+void mock_driver::set_options(const mock_options& opts)
+{
+    _opts = opts;
+    _rng.seed(opts.seed);
+}
+
+error_code mock_driver::_begin(std::uint64_t& counter)
+{
+    ++counter;
+    if (_opts.error_rate <= 0) return {};
+    std::bernoulli_distribution fail{std::min(_opts.error_rate, 1.0)};
+    if (!fail(_rng)) return {};
+    ++_stats.errors;
+    return _opts.error;
+}
+
+std::chrono::nanoseconds mock_driver::_service_time()
+{
+    auto time = _opts.service_time;
+    if (_opts.jitter.count() > 0)
+    {
+        std::uniform_int_distribution<std::chrono::nanoseconds::rep> jitter{
+            0, _opts.jitter.count()};
+        time += std::chrono::nanoseconds{jitter(_rng)};
+    }
+    return time;
+}
+
+void mock_driver::_wait()
+{
+    const auto time = _service_time();
+    if (time.count() > 0) std::this_thread::sleep_for(time);
+}
+
+error_code mock_driver::open(const string&)
+{
+    const auto ec = _begin(_stats.opens);
+    _wait();
+    if (!ec) _open = true;
+    return ec;
+}
+
+mock_statement mock_driver::prepare(const string& query, error_code& ec)
+{
+    ec = _begin(_stats.prepares);
+    _wait();
+    if (ec) return statement{};
+    return statement{query};
+}
+
+void mock_driver::execute(statement& st, error_code& ec)
+{
+    ec = _begin(_stats.executes);
+    _wait();
+    if (!ec) st._done = true;
+}
+
+row mock_driver::_step(mock_statement& st, error_code& ec)
+{
+    ec = _begin(_stats.steps);
+    if (ec || st._done) return row({});
+    if (st._next_row >= _opts.rows)
+    {
+        st._done = true;
+        return row({});
+    }
+    std::vector<value> values;
+    values.reserve(_opts.columns);
+    for (std::size_t n = 0; n < _opts.columns; ++n)
+        values.emplace_back(value::integer(st._next_row + n));
+    ++st._next_row;
+    return row(std::move(values));
+}
+
+row mock_driver::step(statement& st, error_code& ec)
+{
+    auto r = _step(st, ec);
+    _wait();
+    return r;
+}
+
+} /* adio */
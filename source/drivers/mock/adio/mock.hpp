@@ -0,0 +1,250 @@
+#ifndef ADIO_MOCK_DRIVER_HPP_INCLUDED
+#define ADIO_MOCK_DRIVER_HPP_INCLUDED
+
+#include <adio/connection_fwd.hpp>
+#include <adio/error.hpp>
+#include <adio/service.hpp>
+#include <adio/sql/row.hpp>
+
+#include <boost/asio/steady_timer.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <random>
+
+namespace adio
+{
+
+class mock_service;
+
+/// The behaviour injected into the operations of a ``mock_driver``
+struct mock_options
+{
+    /// How long each operation takes
+    std::chrono::nanoseconds service_time{0};
+    /// Each operation takes up to this much longer than ``service_time``,
+    /// chosen uniformly at random
+    std::chrono::nanoseconds jitter{0};
+    /// The fraction of operations, from zero to one, that fail with ``error``
+    double error_rate = 0;
+    error_code error = make_error_code(sys_errc::io_error);
+    /// The number of rows produced by each statement
+    std::size_t rows = 1;
+    /// The number of columns of each row. Column ``n`` of row ``r`` holds the
+    /// integer ``r + n``.
+    std::size_t columns = 1;
+    /// Seeds the choice of jitter and errors, so that runs can be repeated
+    std::uint32_t seed = 1;
+};
+
+/// Counts of the operations run by a ``mock_driver``
+struct mock_stats
+{
+    std::uint64_t opens = 0;
+    std::uint64_t prepares = 0;
+    std::uint64_t executes = 0;
+    std::uint64_t steps = 0;
+    /// Operations which failed with an injected error
+    std::uint64_t errors = 0;
+};
+
+/// A statement of the ``mock_driver``, which remembers its SQL and how many
+/// rows it has produced
+class mock_statement
+{
+    friend class mock_driver;
+
+    string _sql;
+    std::size_t _next_row = 0;
+    bool _done = false;
+
+public:
+    mock_statement() = default;
+    explicit mock_statement(string sql)
+        : _sql{std::move(sql)}
+    {
+    }
+
+    const string& sql() const { return _sql; }
+    /// Whether all the rows of the statement have been produced
+    bool done() const { return _done; }
+    /// Start producing rows from the first again
+    void reset()
+    {
+        _next_row = 0;
+        _done = false;
+    }
+};
+
+/**
+ * A database driver which does no I/O at all.
+ *
+ * Use it to measure what adio itself costs, apart from any database, and to
+ * test code that runs queries without needing a database. The time each
+ * operation takes and how often it fails are set by ``mock_options``.
+ *
+ * Synchronous operations sleep for their service time. Asynchronous
+ * operations never block a thread: an operation with no service time posts
+ * its handler to the connection's ``io_service`` straight away, and any other
+ * waits on a timer first. The effects of an operation, such as advancing a
+ * statement, happen when it starts; only its completion is delayed.
+ *
+ * Like other connections, a driver must not be used on several threads at
+ * once.
+ */
+class mock_driver : public std::enable_shared_from_this<mock_driver>
+{
+    std::reference_wrapper<asio::io_service> _parent_ios;
+    mock_options _opts;
+    mock_stats _stats;
+    std::minstd_rand _rng;
+    bool _open = false;
+
+    /// Count an operation and decide whether it fails
+    error_code _begin(std::uint64_t& counter);
+    /// Choose how long the next operation takes
+    std::chrono::nanoseconds _service_time();
+    /// Wait for the service time of a synchronous operation
+    void _wait();
+
+    row _step(mock_statement& st, error_code& ec);
+
+    /// Complete an asynchronous operation by calling ``fn`` after its service
+    /// time
+    template <typename Fn> void _complete(Fn&& fn)
+    {
+        const auto delay = _service_time();
+        if (delay.count() <= 0)
+        {
+            _parent_ios.get().post(std::forward<Fn>(fn));
+            return;
+        }
+        auto timer = std::make_shared<asio::steady_timer>(_parent_ios.get());
+        timer->expires_from_now(delay);
+        timer->async_wait([
+            this_pin = shared_from_this(),
+            timer,
+            fn = std::forward<Fn>(fn)
+        ](error_code) mutable { fn(); });
+    }
+
+public:
+    using self_type = mock_driver;
+
+    using statement = mock_statement;
+    using service = mock_service;
+    using connection = basic_connection<mock_driver>;
+
+    mock_driver(mock_service& service);
+
+    /// Change the behaviour of later operations. This also restarts the
+    /// random choices from ``opts.seed``.
+    void set_options(const mock_options& opts);
+    const mock_options& options() const { return _opts; }
+
+    const mock_stats& stats() const { return _stats; }
+    void reset_stats() { _stats = {}; }
+
+    bool is_open() const { return _open; }
+
+    using open_handler_signature = void(error_code);
+    error_code open(const string& path);
+    template <typename Handler>
+    void async_open(const string& path, Handler&& handler)
+    {
+        (void)path;
+        const auto ec = _begin(_stats.opens);
+        if (!ec) _open = true;
+        _complete(std::bind(std::forward<Handler>(handler), ec));
+    }
+
+    using prepare_handler_signature = void(statement, error_code);
+    statement prepare(const string& query, error_code& ec);
+    statement prepare(const string& query)
+    {
+        error_code ec;
+        auto st = prepare(query, ec);
+        detail::throw_if_error(ec,
+                               "Failed to prepare statement: \"" + query
+                                   + "\"");
+        return st;
+    }
+    template <typename Handler>
+    void async_prepare(const string& query, Handler&& handler)
+    {
+        const auto ec = _begin(_stats.prepares);
+        _complete([
+            st = ec ? statement{} : statement{query},
+            ec,
+            handler = std::forward<Handler>(handler)
+        ]() mutable { handler(std::move(st), ec); });
+    }
+
+    /// Execute a statement, discarding all the rows it has left
+    using execute_handler_signature = void(error_code);
+    void execute(statement& st, error_code& ec);
+    void execute(statement& st)
+    {
+        error_code ec;
+        execute(st, ec);
+        detail::throw_if_error(ec, "Failed to execute statement");
+    }
+    void execute(const string& query, error_code& ec)
+    {
+        statement st{query};
+        execute(st, ec);
+    }
+    void execute(const string& query)
+    {
+        statement st{query};
+        execute(st);
+    }
+    template <typename Handler>
+    void async_execute(statement& st, Handler&& handler)
+    {
+        const auto ec = _begin(_stats.executes);
+        if (!ec) st._done = true;
+        _complete(std::bind(std::forward<Handler>(handler), ec));
+    }
+    template <typename Handler>
+    void async_execute(const string& query, Handler&& handler)
+    {
+        statement st{query};
+        async_execute(st, std::forward<Handler>(handler));
+    }
+
+    /// Produce the next row of a statement, or an empty row once it is done
+    using step_handler_signature = void(row, error_code);
+    row step(statement& st, error_code& ec);
+    row step(statement& st)
+    {
+        error_code ec;
+        auto r = step(st, ec);
+        detail::throw_if_error(ec, "Failed to step query");
+        return r;
+    }
+    template <typename Handler>
+    void async_step(statement& st, Handler&& handler)
+    {
+        error_code ec;
+        auto r = _step(st, ec);
+        _complete([
+            r = std::move(r),
+            ec,
+            handler = std::forward<Handler>(handler)
+        ]() mutable { handler(std::move(r), ec); });
+    }
+
+    void close() { _open = false; }
+};
+
+class mock_service : public detail::db_service_base<mock_service, mock_driver>
+{
+public:
+    using db_service_base<mock_service, mock_driver>::db_service_base;
+};
+
+} /* adio */
+
+#endif  // ADIO_MOCK_DRIVER_HPP_INCLUDED
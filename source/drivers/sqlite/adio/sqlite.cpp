@@ -4,6 +4,18 @@
 
 #include <adio/sql/value.hpp>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <list>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <unordered_map>
+
 using namespace adio;
 using detail::sqlite_statement;
 using detail::sqlite_service;
@@ -20,21 +32,323 @@ class sqlite_category : public asio_error_category
     string message(int e) const override { return ::sqlite3_errstr(e); }
 };
 
-struct sqlite_private
+/// Statement statistics totals for one connection, by SQL text
+class sqlite_stats_registry
 {
-    ::sqlite3* db = nullptr;
-    ~sqlite_private()
+    mutable std::mutex _mutex;
+    std::map<string, sqlite_statement_stats> _totals;
+
+public:
+    void add(const char* sql, const sqlite_statement_stats& stats)
+    {
+        std::lock_guard<std::mutex> lk{_mutex};
+        _totals[sql ? sql : ""] += stats;
+    }
+
+    std::vector<std::pair<string, sqlite_statement_stats>> snapshot() const
     {
-        if (db) ::sqlite3_close(db);
+        std::lock_guard<std::mutex> lk{_mutex};
+        return {_totals.begin(), _totals.end()};
     }
 };
 
 struct sqlite_statement_private
 {
     ::sqlite3_stmt* st = nullptr;
+    /// The SQL the statement was compiled from. Only set for statements that
+    /// may be returned to the statement cache.
+    std::string sql;
+    /// Named parameters and their indices, sorted by name. Built on first use.
+    std::vector<std::pair<std::string, int>> params;
+    bool params_indexed = false;
+
+    int param_index(string_view name)
+    {
+        if (!params_indexed)
+        {
+            const auto count = ::sqlite3_bind_parameter_count(st);
+            for (auto i = 1; i <= count; ++i)
+            {
+                // Anonymous "?" parameters have no name
+                if (const auto n = ::sqlite3_bind_parameter_name(st, i))
+                    params.emplace_back(n, i);
+            }
+            std::sort(params.begin(), params.end());
+            params_indexed = true;
+        }
+        const auto it = std::lower_bound(
+            params.begin(),
+            params.end(),
+            name,
+            [](const std::pair<std::string, int>& p, string_view n) {
+                return string_view{p.first} < n;
+            });
+        if (it == params.end() || string_view{it->first} != name) return 0;
+        return it->second;
+    }
+
+    /// Where to add this statement's statistics. Null if they aren't being
+    /// collected.
+    std::shared_ptr<sqlite_stats_registry> registry;
+    std::uint64_t runs = 0;
+    std::chrono::nanoseconds step_time{0};
+    /// Whether the statement has been stepped since it was last reset
+    bool running = false;
+
+    int step()
+    {
+        if (!running)
+        {
+            ++runs;
+            running = true;
+        }
+        int rc;
+        if (registry)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            rc = ::sqlite3_step(st);
+            step_time += std::chrono::steady_clock::now() - start;
+        }
+        else
+        {
+            rc = ::sqlite3_step(st);
+        }
+        if (rc != SQLITE_ROW) running = false;
+        return rc;
+    }
+
+    sqlite_statement_stats stats(bool reset)
+    {
+        const auto status = [&](int op) {
+            return std::uint64_t(::sqlite3_stmt_status(st, op, reset));
+        };
+        sqlite_statement_stats ret;
+        ret.fullscan_steps = status(SQLITE_STMTSTATUS_FULLSCAN_STEP);
+        ret.sorts = status(SQLITE_STMTSTATUS_SORT);
+        ret.autoindexes = status(SQLITE_STMTSTATUS_AUTOINDEX);
+#ifdef SQLITE_STMTSTATUS_VM_STEP
+        ret.vm_steps = status(SQLITE_STMTSTATUS_VM_STEP);
+#endif
+#ifdef SQLITE_STMTSTATUS_REPREPARE
+        ret.reprepares = status(SQLITE_STMTSTATUS_REPREPARE);
+#endif
+        ret.runs = runs;
+        ret.step_time = step_time;
+        if (reset)
+        {
+            runs = 0;
+            step_time = step_time.zero();
+        }
+        return ret;
+    }
+
+    /// Move the statistics gathered so far into the registry
+    void harvest()
+    {
+        running = false;
+        const auto s = stats(true);
+        if (registry && s.runs) registry->add(::sqlite3_sql(st), s);
+    }
+
     ~sqlite_statement_private()
     {
-        if (st) ::sqlite3_finalize(st);
+        if (!st) return;
+        harvest();
+        ::sqlite3_finalize(st);
+    }
+};
+
+/**
+ * A bounded LRU cache of compiled statements that are not currently in use,
+ * keyed by their SQL text. Statements are checked out of the cache by
+ * prepare(), and returned to it when the last ``sqlite_statement`` referring
+ * to them is destroyed.
+ */
+class sqlite_statement_cache
+{
+    using entry_ptr = std::unique_ptr<sqlite_statement_private>;
+    using lru_list = std::list<entry_ptr>;
+
+    mutable std::mutex _mutex;
+    std::size_t _capacity;
+    // Most recently used at the front
+    lru_list _lru;
+    std::unordered_map<string, lru_list::iterator> _index;
+    std::size_t _hits = 0;
+    std::size_t _misses = 0;
+
+    void _trim()
+    {
+        while (_lru.size() > _capacity)
+        {
+            _index.erase(_lru.back()->sql);
+            _lru.pop_back();
+        }
+    }
+
+public:
+    explicit sqlite_statement_cache(std::size_t capacity)
+        : _capacity{capacity}
+    {
+    }
+
+    /// Take a statement for the given SQL out of the cache, or nullptr.
+    entry_ptr take(const string& sql)
+    {
+        std::lock_guard<std::mutex> lk{_mutex};
+        const auto it = _index.find(sql);
+        if (it == _index.end())
+        {
+            ++_misses;
+            return nullptr;
+        }
+        ++_hits;
+        auto ret = std::move(*it->second);
+        _lru.erase(it->second);
+        _index.erase(it);
+        return ret;
+    }
+
+    /// Return a statement to the cache once nobody is using it
+    void put(entry_ptr p)
+    {
+        // Reset right away so that an idle statement never keeps a read
+        // transaction open on the database. This may run on any thread, so
+        // hold the connection's mutex to keep it from interleaving with the
+        // lane (see sqlite).
+        const auto db_mutex = ::sqlite3_db_mutex(::sqlite3_db_handle(p->st));
+        ::sqlite3_mutex_enter(db_mutex);
+        ::sqlite3_reset(p->st);
+        ::sqlite3_clear_bindings(p->st);
+        p->harvest();
+        ::sqlite3_mutex_leave(db_mutex);
+        std::lock_guard<std::mutex> lk{_mutex};
+        if (_capacity == 0 || _index.count(p->sql)) return;
+        _lru.push_front(std::move(p));
+        _index.emplace(_lru.front()->sql, _lru.begin());
+        _trim();
+    }
+
+    void set_capacity(std::size_t cap)
+    {
+        std::lock_guard<std::mutex> lk{_mutex};
+        _capacity = cap;
+        _trim();
+    }
+
+    std::size_t capacity() const
+    {
+        std::lock_guard<std::mutex> lk{_mutex};
+        return _capacity;
+    }
+
+    sqlite_statement_cache_stats stats() const
+    {
+        std::lock_guard<std::mutex> lk{_mutex};
+        return {_hits, _misses, _lru.size(), _capacity};
+    }
+};
+
+/// An asynchronous operation queued or running on a connection
+struct sqlite_op_state : std::enable_shared_from_this<sqlite_op_state>
+{
+    sqlite_op_state(io_service& ios,
+                    std::uint64_t generation_,
+                    const sqlite_retry_policy& retry_,
+                    const sqlite_op_options& opts,
+                    std::function<error_code()> attempt_,
+                    std::function<void(error_code)> done_)
+        : generation(generation_)
+        , retry(retry_)
+        , deadline(opts.deadline)
+        , attempt(std::move(attempt_))
+        , done(std::move(done_))
+        , timer(ios)
+    {
+    }
+
+    /// The connection's cancellation generation when the operation started
+    const std::uint64_t generation;
+    const sqlite_retry_policy retry;
+    const boost::optional<std::chrono::steady_clock::time_point> deadline;
+    const std::function<error_code()> attempt;
+    const std::function<void(error_code)> done;
+    /// Runs one attempt on the connection's lane
+    std::function<void()> run;
+    asio::steady_timer timer;
+    std::size_t retries = 0;
+};
+
+struct sqlite_private
+{
+    explicit sqlite_private(io_service& ios)
+        : strand{ios}
+        , group_timer{ios}
+    {
+    }
+
+    ::sqlite3* db = nullptr;
+    /// Serializes the tasks of a single connection on the service threads
+    io_service::strand strand;
+    /// Statements compiled against ``db``. Replaced whenever ``db`` is closed,
+    /// so that statements still checked out of the old cache are finalized
+    /// rather than returned to it.
+    std::shared_ptr<sqlite_statement_cache> cache
+        = std::make_shared<sqlite_statement_cache>(
+            sqlite::default_statement_cache_capacity);
+    /// Statement statistics totals, if enabled
+    std::shared_ptr<sqlite_stats_registry> stats_registry;
+    /// The statement trace, if enabled
+    boost::optional<sqlite_trace_options> trace;
+    /// The connection that owns this, for trace events
+    const sqlite* owner = nullptr;
+    /// Bumped by cancel(). Operations started under an older generation are
+    /// cancelled.
+    std::atomic<std::uint64_t> generation{0};
+    /// The operation whose attempt is running. Only set on the connection's
+    /// lane, but read by the progress handler on whichever thread is
+    /// stepping a statement.
+    std::atomic<const sqlite_op_state*> current_op{nullptr};
+    /// Operations waiting to retry. Only used on the connection's lane.
+    std::vector<std::weak_ptr<sqlite_op_state>> waiting;
+
+    // Group commit state. Only used on the connection's lane.
+    /// Whether a shared group commit transaction is open. Also read by
+    /// synchronous operations, which are refused while it is set.
+    std::atomic<bool> group_open{false};
+    /// Completion handlers of the writes in the open group
+    std::vector<std::function<void(error_code)>> group_writes;
+    /// Commits the group when its window closes
+    asio::steady_timer group_timer;
+    /// Counts groups, so that a stale timer doesn't commit a later group
+    std::uint64_t group_number = 0;
+
+    /// Transaction control statements, compiled on first use and finalized
+    /// when the database is closed. Indexed by ``control_statement``.
+    std::array<::sqlite3_stmt*, 8> control{};
+    /// SAVEPOINT, RELEASE and ROLLBACK TO statements for each savepoint
+    /// depth, starting from one
+    std::vector<std::array<::sqlite3_stmt*, 3>> savepoint_control;
+    /// The depth of the innermost savepoint created by begin()
+    std::size_t savepoint_depth = 0;
+
+    void finalize_control()
+    {
+        for (auto& st : control) ::sqlite3_finalize(st);
+        control.fill(nullptr);
+        for (auto& sts : savepoint_control)
+        {
+            for (auto st : sts) ::sqlite3_finalize(st);
+        }
+        savepoint_control.clear();
+        savepoint_depth = 0;
+    }
+
+    ~sqlite_private()
+    {
+        cache.reset();
+        finalize_control();
+        if (db) ::sqlite3_close_v2(db);
     }
 };
 
@@ -42,6 +356,8 @@ struct sqlite_statement_private
 
 } /* adio */
 
+constexpr std::size_t sqlite::default_statement_cache_capacity;
+
 const asio_error_category& adio::sqlite_category()
 {
     static detail::sqlite_category cat;
@@ -51,8 +367,9 @@ const asio_error_category& adio::sqlite_category()
 sqlite::sqlite(service& service)
     : _parent_ios{service.get_io_service()}
     , _service{service}
-    , _private{new detail::sqlite_private}
+    , _private{new detail::sqlite_private{service._my_ios}}
 {
+    _private->owner = this;
 }
 
 sqlite_statement::sqlite_statement() = default;
@@ -65,7 +382,7 @@ sqlite_statement::sqlite_statement(
 
 bool sqlite_statement::_advance()
 {
-    auto rc = ::sqlite3_step(_private->st);
+    auto rc = _private->step();
     switch (rc)
     {
     case SQLITE_DONE:
@@ -81,11 +398,22 @@ bool sqlite_statement::_advance()
     }
 }
 
+void sqlite_statement::_check_width(std::size_t width) const
+{
+    const auto columns = ::sqlite3_column_count(_private->st);
+    if (static_cast<std::size_t>(columns) != width)
+        throw std::invalid_argument{"Cannot fetch "
+                                    + std::to_string(columns)
+                                    + " columns into a tuple of size "
+                                    + std::to_string(width)};
+    _checked_width = width;
+}
+
 void sqlite_statement::execute(error_code& ec)
 {
     while (1)
     {
-        auto rc = ::sqlite3_step(_private->st);
+        auto rc = _private->step();
         switch (rc)
         {
         case SQLITE_DONE:
@@ -101,19 +429,382 @@ void sqlite_statement::execute(error_code& ec)
     }
 }
 
-sqlite::sqlite(sqlite&&) = default;
-sqlite& sqlite::operator=(sqlite&&) = default;
+std::size_t sqlite_statement::fetch_columns(column_batch& out,
+                                            std::size_t max_rows,
+                                            error_code& ec)
+{
+    ec = {};
+    const auto pst = _private->st;
+    const auto num_columns
+        = static_cast<std::size_t>(::sqlite3_column_count(pst));
+    out.clear();
+    out.columns.resize(num_columns);
+    for (auto i = 0u; i < num_columns; ++i)
+    {
+        auto& col = out.columns[i];
+        const auto name = ::sqlite3_column_name(pst, int(i));
+        col.name = name ? name : "";
+    }
+    while (!_done && out.rows < max_rows)
+    {
+        const auto rc = _private->step();
+        if (rc == SQLITE_DONE)
+        {
+            _done = true;
+            break;
+        }
+        if (rc != SQLITE_ROW)
+        {
+            ec = make_error_code(static_cast<sqlite_errc>(rc));
+            break;
+        }
+        for (auto i = 0u; i < num_columns; ++i)
+        {
+            auto& col = out.columns[i];
+            const auto c = int(i);
+            auto t = col.type();
+            if (::sqlite3_column_type(pst, c) == SQLITE_NULL)
+            {
+                col.push_null();
+                continue;
+            }
+            if (t == type::null_t)
+            {
+                t = current_view().column_type(i);
+                if (out.rows == 0) col.reserve(max_rows);
+            }
+            switch (t)
+            {
+            case type::integer:
+                col.push_integer(::sqlite3_column_int64(pst, c));
+                break;
+            case type::real:
+                col.push_real(::sqlite3_column_double(pst, c));
+                break;
+            case type::text:
+            {
+                const auto ptr = reinterpret_cast<const char*>(
+                    ::sqlite3_column_text(pst, c));
+                const auto len = ::sqlite3_column_bytes(pst, c);
+                col.push_bytes(t, ptr, static_cast<std::size_t>(len));
+                break;
+            }
+            case type::blob:
+            {
+                const auto ptr = reinterpret_cast<const char*>(
+                    ::sqlite3_column_blob(pst, c));
+                const auto len = ::sqlite3_column_bytes(pst, c);
+                col.push_bytes(t, ptr, static_cast<std::size_t>(len));
+                break;
+            }
+            default:
+                assert(0);
+                std::terminate();
+            }
+        }
+        ++out.rows;
+    }
+    return out.rows;
+}
+
+void sqlite_statement::reset()
+{
+    // sqlite3_reset() repeats the error from the last step, if any. That error
+    // was already reported by that step, so we don't report it again here.
+    ::sqlite3_reset(_private->st);
+    _private->running = false;
+    _done = false;
+}
+
+sqlite_statement_stats sqlite_statement::stats() const
+{
+    return _private->stats(false);
+}
+
+bool sqlite_statement::readonly() const
+{
+    return ::sqlite3_stmt_readonly(_private->st) != 0;
+}
+
+sqlite_statement::native_handle_type sqlite_statement::native_handle() const
+{
+    return _private ? _private->st : nullptr;
+}
+
+void sqlite_statement::clear_bindings()
+{
+    ::sqlite3_clear_bindings(_private->st);
+}
+
+sqlite::sqlite(sqlite&& other)
+    : _parent_ios{other._parent_ios}
+    , _service{other._service}
+    , _private{std::move(other._private)}
+    , _retry_policy{std::move(other._retry_policy)}
+    , _group_commit{std::move(other._group_commit)}
+{
+    // Trace events name the connection by address
+    if (_private) _private->owner = this;
+}
+
+sqlite& sqlite::operator=(sqlite&& other)
+{
+    if (this == &other) return *this;
+    if (_private) close();
+    _parent_ios = other._parent_ios;
+    _service = other._service;
+    _private = std::move(other._private);
+    _retry_policy = std::move(other._retry_policy);
+    _group_commit = std::move(other._group_commit);
+    if (_private) _private->owner = this;
+    return *this;
+}
+
+sqlite::~sqlite()
+{
+    // Nothing to close if moved from
+    if (_private) close();
+}
+
+namespace
+{
+
+/// Run a PRAGMA, optionally getting the first column of its result
+int run_pragma(::sqlite3* db, const string& sql, string* result = nullptr)
+{
+    ::sqlite3_stmt* st = nullptr;
+    auto rc
+        = ::sqlite3_prepare_v2(db, sql.data(), int(sql.size()), &st, nullptr);
+    if (rc != SQLITE_OK) return rc;
+    while ((rc = ::sqlite3_step(st)) == SQLITE_ROW)
+    {
+        if (result && ::sqlite3_column_type(st, 0) != SQLITE_NULL)
+        {
+            *result = reinterpret_cast<const char*>(
+                ::sqlite3_column_text(st, 0));
+        }
+    }
+    ::sqlite3_finalize(st);
+    return rc == SQLITE_DONE ? SQLITE_OK : rc;
+}
+
+const char* journal_mode_name(sqlite_journal_mode m)
+{
+    switch (m)
+    {
+    case sqlite_journal_mode::delete_:
+        return "delete";
+    case sqlite_journal_mode::truncate:
+        return "truncate";
+    case sqlite_journal_mode::persist:
+        return "persist";
+    case sqlite_journal_mode::memory:
+        return "memory";
+    case sqlite_journal_mode::wal:
+        return "wal";
+    case sqlite_journal_mode::off:
+        return "off";
+    default:
+        assert(0);
+        std::terminate();
+    }
+}
+
+const char* synchronous_name(sqlite_synchronous s)
+{
+    switch (s)
+    {
+    case sqlite_synchronous::off:
+        return "OFF";
+    case sqlite_synchronous::normal:
+        return "NORMAL";
+    case sqlite_synchronous::full:
+        return "FULL";
+    case sqlite_synchronous::extra:
+        return "EXTRA";
+    default:
+        assert(0);
+        std::terminate();
+    }
+}
+
+const char* temp_store_name(sqlite_temp_store t)
+{
+    switch (t)
+    {
+    case sqlite_temp_store::default_:
+        return "DEFAULT";
+    case sqlite_temp_store::file:
+        return "FILE";
+    case sqlite_temp_store::memory:
+        return "MEMORY";
+    default:
+        assert(0);
+        std::terminate();
+    }
+}
+
+int apply_open_options(::sqlite3* db, const sqlite_open_options& opts)
+{
+    // Set the busy timeout first, so that the pragmas which need a lock on
+    // the database (eg. journal_mode) wait for it.
+    if (opts.busy_timeout)
+    {
+        const auto rc
+            = ::sqlite3_busy_timeout(db, int(opts.busy_timeout->count()));
+        if (rc != SQLITE_OK) return rc;
+    }
+    if (opts.journal_mode != sqlite_journal_mode::unchanged)
+    {
+        const string mode = journal_mode_name(opts.journal_mode);
+        string result;
+        const auto rc
+            = run_pragma(db, "PRAGMA journal_mode = " + mode, &result);
+        if (rc != SQLITE_OK) return rc;
+        // SQLite reports the mode it actually ended up in. Don't silently
+        // run in a different mode than was asked for.
+        if (result != mode) return SQLITE_ERROR;
+    }
+    std::vector<string> pragmas;
+    if (opts.synchronous != sqlite_synchronous::unchanged)
+    {
+        pragmas.push_back(string{"PRAGMA synchronous = "}
+                          + synchronous_name(opts.synchronous));
+    }
+    if (opts.temp_store != sqlite_temp_store::unchanged)
+    {
+        pragmas.push_back(string{"PRAGMA temp_store = "}
+                          + temp_store_name(opts.temp_store));
+    }
+    if (opts.mmap_size)
+        pragmas.push_back("PRAGMA mmap_size = "
+                          + std::to_string(*opts.mmap_size));
+    if (opts.cache_size)
+        pragmas.push_back("PRAGMA cache_size = "
+                          + std::to_string(*opts.cache_size));
+    if (opts.threads)
+        pragmas.push_back("PRAGMA threads = " + std::to_string(*opts.threads));
+    for (const auto& pragma : pragmas)
+    {
+        const auto rc = run_pragma(db, pragma);
+        if (rc != SQLITE_OK) return rc;
+    }
+    return SQLITE_OK;
+}
+
+/// Called by SQLite while statements run. Interrupts the running statement
+/// if its operation has been cancelled or has passed its deadline.
+int check_progress(void* p)
+{
+    const auto& priv = *static_cast<const detail::sqlite_private*>(p);
+    const auto op = priv.current_op.load(std::memory_order_acquire);
+    if (!op) return 0;
+    if (op->generation != priv.generation.load()) return 1;
+    return op->deadline && std::chrono::steady_clock::now() >= *op->deadline;
+}
+
+/// Number of virtual machine instructions between calls to check_progress
+constexpr int progress_interval = 1000;
+
+/// Pass a statement that has finished running to the trace sink, if it ran
+/// for long enough
+void trace_statement(const detail::sqlite_private& priv,
+                     ::sqlite3_stmt* st,
+                     const char* sql,
+                     std::chrono::nanoseconds duration)
+{
+    const auto& trace = *priv.trace;
+    if (duration < trace.threshold || !trace.sink) return;
+    sqlite_trace_event event;
+    event.duration = duration;
+    event.connection = priv.owner;
+    event.finished = std::chrono::system_clock::now();
+#ifdef SQLITE_TRACE_PROFILE
+    if (trace.expand_sql && st)
+    {
+        if (const auto expanded = ::sqlite3_expanded_sql(st))
+        {
+            event.sql = expanded;
+            ::sqlite3_free(expanded);
+        }
+    }
+#else
+    (void)st;
+#endif
+    if (event.sql.empty() && sql) event.sql = sql;
+    trace.sink->record(event);
+}
+
+#ifdef SQLITE_TRACE_PROFILE
+int on_trace(unsigned type, void* p, void* st, void* ns)
+{
+    if (type != SQLITE_TRACE_PROFILE) return 0;
+    const auto stmt = static_cast<::sqlite3_stmt*>(st);
+    trace_statement(*static_cast<const detail::sqlite_private*>(p),
+                    stmt,
+                    ::sqlite3_sql(stmt),
+                    std::chrono::nanoseconds{*static_cast<::sqlite3_int64*>(
+                        ns)});
+    return 0;
+}
+#else
+// SQLite before 3.14 has no sqlite3_trace_v2. The older profiling hook gives
+// us the unexpanded SQL and the duration.
+void on_profile(void* p, const char* sql, ::sqlite3_uint64 ns)
+{
+    trace_statement(*static_cast<const detail::sqlite_private*>(p),
+                    nullptr,
+                    sql,
+                    std::chrono::nanoseconds{ns});
+}
+#endif
+
+/// Install or remove the profiling hook of a connection
+void install_trace(detail::sqlite_private& priv, bool enabled)
+{
+    if (!priv.db) return;
+#ifdef SQLITE_TRACE_PROFILE
+    ::sqlite3_trace_v2(priv.db,
+                       enabled ? SQLITE_TRACE_PROFILE : 0,
+                       enabled ? &on_trace : nullptr,
+                       &priv);
+#else
+    ::sqlite3_profile(priv.db, enabled ? &on_profile : nullptr, &priv);
+#endif
+}
 
-sqlite::~sqlite() { close(); }
+} /* anonymous namespace */
 
-error_code sqlite::open(const string& path)
+error_code sqlite::open(const string& path, const sqlite_open_options& opts)
 {
     close();
-    const auto err = ::sqlite3_open(path.data(), &_private->db);
-    if (err != SQLITE_OK) return make_error_code(static_cast<sqlite_errc>(err));
+    auto flags = opts.flags ? opts.flags
+                            : SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+    // Tasks on the lane never overlap, but statements are reset, finalized
+    // and returned to the cache on whichever thread drops them, so the
+    // connection needs SQLite's serialized threading mode
+    if (!(flags & SQLITE_OPEN_NOMUTEX)) flags |= SQLITE_OPEN_FULLMUTEX;
+    auto err = ::sqlite3_open_v2(path.data(), &_private->db, flags, nullptr);
+    if (err == SQLITE_OK) err = apply_open_options(_private->db, opts);
+    if (err != SQLITE_OK)
+    {
+        close();
+        return make_error_code(static_cast<sqlite_errc>(err));
+    }
+    ::sqlite3_progress_handler(_private->db,
+                               progress_interval,
+                               &check_progress,
+                               _private.get());
+    install_trace(*_private, !!_private->trace);
     return {};
 }
 
+void sqlite::set_trace(const boost::optional<sqlite_trace_options>& opts)
+{
+    _private->trace = opts;
+    install_trace(*_private, !!opts);
+}
+
 std::shared_ptr<detail::sqlite_statement_private>
 sqlite::_prepare(const string& str, error_code& e) const
 {
@@ -122,19 +813,33 @@ sqlite::_prepare(const string& str, error_code& e) const
         e = make_error_code(adio::sys_errc::not_connected);
         return {};
     }
-    auto p = detail::make_unique<detail::sqlite_statement_private>();
-    auto err = ::sqlite3_prepare_v2(_private->db,
-                                    str.data(),
-                                    str.size(),
-                                    &p->st,
-                                    nullptr);
-    if (err)
+    auto& cache = _private->cache;
+    const auto use_cache = cache->capacity() != 0;
+    auto p = use_cache ? cache->take(str) : nullptr;
+    if (!p)
     {
+        p = detail::make_unique<detail::sqlite_statement_private>();
+        auto err = ::sqlite3_prepare_v2(_private->db,
+                                        str.data(),
+                                        str.size(),
+                                        &p->st,
+                                        nullptr);
         if (err != SQLITE_OK)
+        {
             e = make_error_code(static_cast<sqlite_errc>(err));
-        return nullptr;
+            return nullptr;
+        }
     }
-    return {std::move(p)};
+    p->registry = _private->stats_registry;
+    if (!use_cache) return {std::move(p)};
+    p->sql = str;
+    // Hand the statement back to the cache rather than finalizing it, unless
+    // the connection has been closed (and its cache dropped) in the meantime
+    std::weak_ptr<detail::sqlite_statement_cache> weak_cache = cache;
+    return {p.release(), [weak_cache](detail::sqlite_statement_private* ptr) {
+                std::unique_ptr<detail::sqlite_statement_private> owned{ptr};
+                if (auto c = weak_cache.lock()) c->put(std::move(owned));
+            }};
 }
 
 std::vector<sqlite::statement> sqlite::_multi_prepare(const string& source,
@@ -162,6 +867,7 @@ std::vector<sqlite::statement> sqlite::_multi_prepare(const string& source,
             e = make_error_code(static_cast<sqlite_errc>(err));
             return {};
         }
+        p->registry = _private->stats_registry;
         ret.emplace_back(std::move(p));
         if (next_ptr == nullptr) break;
         // There's another statement to compile. Go around again
@@ -171,136 +877,1057 @@ std::vector<sqlite::statement> sqlite::_multi_prepare(const string& source,
     return ret;
 }
 
-void sqlite::close()
+namespace
 {
-    if (_private->db)
+
+enum control_statement
+{
+    begin_deferred,
+    begin_immediate,
+    begin_exclusive,
+    commit_transaction,
+    rollback_transaction,
+    group_savepoint,
+    group_release,
+    group_rollback_to,
+};
+
+const char* const control_sql[] = {
+    "BEGIN DEFERRED",
+    "BEGIN IMMEDIATE",
+    "BEGIN EXCLUSIVE",
+    "COMMIT",
+    "ROLLBACK",
+    "SAVEPOINT adio_group_write",
+    "RELEASE adio_group_write",
+    "ROLLBACK TO adio_group_write",
+};
+
+enum savepoint_statement
+{
+    create_savepoint,
+    release_savepoint,
+    rollback_to_savepoint,
+};
+
+/// Run a statement that returns no rows, compiling it into ``slot`` first if
+/// it hasn't been already
+error_code
+run_control(::sqlite3* db, ::sqlite3_stmt*& slot, const string& sql)
+{
+    if (!db) return make_error_code(adio::sys_errc::not_connected);
+    if (!slot)
     {
-        ::sqlite3_close(_private->db);
-        _private->db = nullptr;
+        const auto rc = ::sqlite3_prepare_v2(
+            db, sql.data(), int(sql.size()), &slot, nullptr);
+        if (rc != SQLITE_OK)
+            return make_error_code(static_cast<sqlite_errc>(rc));
     }
+    const auto rc = ::sqlite3_step(slot);
+    ::sqlite3_reset(slot);
+    if (rc == SQLITE_DONE) return {};
+    return make_error_code(static_cast<sqlite_errc>(rc));
 }
 
-sqlite_service::sqlite_service(io_service& ios)
-    : super_type{ios}
-    , _my_ios{std::thread::hardware_concurrency() * 2}
-    , _workptr{new io_service::work{_my_ios}}
+error_code run_control(detail::sqlite_private& priv, control_statement which)
 {
+    return run_control(priv.db, priv.control[which], control_sql[which]);
 }
 
-sqlite_service::~sqlite_service()
+error_code run_savepoint(detail::sqlite_private& priv,
+                         std::size_t depth,
+                         savepoint_statement which)
 {
-    _workptr.reset();
-    _my_ios.stop();
-    for (auto& t : _threads) t.join();
+    if (priv.savepoint_control.size() < depth)
+        priv.savepoint_control.resize(depth);
+    static const char* const prefixes[] = {
+        "SAVEPOINT", "RELEASE", "ROLLBACK TO",
+    };
+    return run_control(priv.db,
+                       priv.savepoint_control[depth - 1][which],
+                       string{prefixes[which]} + " adio_savepoint_"
+                           + std::to_string(depth));
 }
 
-void sqlite_service::_ensure_threads_started()
+} /* anonymous namespace */
+
+void sqlite::close()
 {
-    std::call_once(_start_threads_flag, [this] {
-        _threads.resize(std::thread::hardware_concurrency());
-        for (auto& t : _threads) t = std::thread{[this] { _my_ios.run(); }};
-    });
+    auto& priv = *_private;
+    if (priv.group_open)
+    {
+        // Roll back now, as statements still in use would keep the handle,
+        // and the transaction's locks, alive after closing. The stale timer
+        // must not commit whatever group is open after the database is
+        // reopened.
+        run_control(priv, rollback_transaction);
+        priv.group_open = false;
+        ++priv.group_number;
+        priv.group_timer.cancel();
+        auto writes = std::move(priv.group_writes);
+        priv.group_writes.clear();
+        for (auto& w : writes)
+            w(adio::asio::error::operation_aborted);
+    }
+    if (_private->db)
+    {
+        // Finalize idle cached statements now. Statements still in use keep
+        // the handle alive (as a zombie) until they are destroyed.
+        const auto capacity = _private->cache->capacity();
+        _private->cache
+            = std::make_shared<detail::sqlite_statement_cache>(capacity);
+        _private->finalize_control();
+        // Statements still in use may outlive this connection, so they must
+        // not report to its trace
+        install_trace(*_private, false);
+        ::sqlite3_close_v2(_private->db);
+        _private->db = nullptr;
+    }
 }
 
-void sqlite_service::_start_task(std::function<void()> task)
+bool sqlite::_batch_begin(error_code& ec)
 {
-    _ensure_threads_started();
-    _my_ios.post(std::move(task));
+    if (!_private->db)
+    {
+        ec = make_error_code(adio::sys_errc::not_connected);
+        return false;
+    }
+    if (!::sqlite3_get_autocommit(_private->db)) return false;
+    ec = run_control(*_private, begin_deferred);
+    return !ec;
 }
 
-row sqlite_statement::current_row() const
+void sqlite::_batch_end(bool commit, error_code& ec)
 {
-    const auto pst = _private->st;
-    const auto num_columns = ::sqlite3_column_count(pst);
-    std::vector<adio::value> values;
-    values.reserve(num_columns);
-
-    for (auto i = 0; i < num_columns; ++i)
+    if (commit)
     {
-        const auto sql_type = ::sqlite3_column_type(pst, i);
+        ec = run_control(*_private, commit_transaction);
+        if (!ec) return;
+    }
+    // Don't leave the transaction open, even if the operation running the
+    // batch has been cancelled
+    const auto op = _private->current_op.exchange(nullptr);
+    const auto rollback_ec = run_control(*_private, rollback_transaction);
+    if (!commit) ec = rollback_ec;
+    _private->current_op.store(op);
+}
 
-        switch (sql_type)
-        {
-        case SQLITE_INTEGER:
-            values.emplace_back(value::integer{::sqlite3_column_int64(pst, i)});
-            break;
-        case SQLITE_FLOAT:
-            values.emplace_back(::sqlite3_column_double(pst, i));
-            break;
-        case SQLITE_TEXT:
-        {
-            const auto ptr = ::sqlite3_column_text(pst, i);
-            const auto len = ::sqlite3_column_bytes(pst, i);
-            std::string str{ptr, ptr + len};
-            values.emplace_back(std::move(str));
-            break;
+error_code sqlite::_batch_exception_error()
+{
+    // Mirrors the exceptions thrown by check_bind_result
+    try
+    {
+        throw;
+    }
+    catch (const std::out_of_range&)
+    {
+        return make_error_code(sqlite_errc::range);
+    }
+    catch (const std::domain_error&)
+    {
+        return make_error_code(sqlite_errc::too_big);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return make_error_code(sqlite_errc::no_memory);
+    }
+    catch (const system_error& e)
+    {
+        return e.code();
+    }
+    catch (...)
+    {
+        return make_error_code(sqlite_errc::misuse);
+    }
+}
+
+sqlite::transaction sqlite::begin(sqlite_transaction_mode mode,
+                                  error_code& ec)
+{
+    ec = {};
+    auto& priv = *_private;
+    if (_refuse_in_group(ec)) return {};
+    if (!priv.db)
+    {
+        ec = make_error_code(adio::sys_errc::not_connected);
+        return {};
+    }
+    if (::sqlite3_get_autocommit(priv.db))
+    {
+        const auto which = mode == sqlite_transaction_mode::immediate
+                               ? begin_immediate
+                               : mode == sqlite_transaction_mode::exclusive
+                                     ? begin_exclusive
+                                     : begin_deferred;
+        ec = run_control(priv, which);
+        if (ec) return {};
+        priv.savepoint_depth = 0;
+        return transaction{shared_from_this(), 0};
+    }
+    // Nest within the transaction that is already open
+    const auto depth = priv.savepoint_depth + 1;
+    ec = run_savepoint(priv, depth, create_savepoint);
+    if (ec) return {};
+    priv.savepoint_depth = depth;
+    return transaction{shared_from_this(), depth};
+}
+
+void sqlite::_end_transaction(std::size_t savepoint,
+                              bool commit,
+                              error_code& ec)
+{
+    auto& priv = *_private;
+    if (savepoint == 0)
+    {
+        ec = run_control(priv,
+                         commit ? commit_transaction : rollback_transaction);
+        if (!ec || !commit) priv.savepoint_depth = 0;
+        return;
+    }
+    if (!commit)
+    {
+        // Rolling back to a savepoint leaves it open, so release it as well
+        ec = run_savepoint(priv, savepoint, rollback_to_savepoint);
+        if (ec) return;
+    }
+    ec = run_savepoint(priv, savepoint, release_savepoint);
+    if (!ec) priv.savepoint_depth = savepoint - 1;
+}
+
+sqlite_transaction& sqlite_transaction::operator=(sqlite_transaction&& other)
+{
+    if (_active)
+    {
+        error_code ignore;
+        rollback(ignore);
+    }
+    _con = std::move(other._con);
+    _savepoint = other._savepoint;
+    _active = other._active;
+    other._active = false;
+    return *this;
+}
+
+sqlite_transaction::~sqlite_transaction()
+{
+    if (!_active) return;
+    error_code ignore;
+    rollback(ignore);
+}
+
+void sqlite_transaction::_end(bool commit, error_code& ec)
+{
+    if (!_active)
+    {
+        ec = make_error_code(adio::sys_errc::invalid_argument);
+        return;
+    }
+    _con->_end_transaction(_savepoint, commit, ec);
+    // A failed rollback can't be retried any better than it was tried, but a
+    // failed commit can
+    if (!ec || !commit) _active = false;
+}
+
+void sqlite_transaction::_async_end(bool commit,
+                                    std::function<void(error_code)> handler)
+{
+    auto& ios = _con->_parent_ios.get();
+    if (!_active)
+    {
+        ios.post(std::bind(handler,
+                           make_error_code(adio::sys_errc::invalid_argument)));
+        return;
+    }
+    _active = false;
+    auto con = _con;
+    const auto savepoint = _savepoint;
+    // Not run through _push_op, so that cancelling the connection's
+    // operations can't leave the transaction open
+    con->_push_task(sqlite_op_kind::execute, [
+        con,
+        work_pin = detail::make_work(ios),
+        savepoint,
+        commit,
+        handler
+    ] {
+        error_code ec;
+        con->_end_transaction(savepoint, commit, ec);
+        if (ec && commit)
+        {
+            error_code ignore;
+            con->_end_transaction(savepoint, false, ignore);
         }
-        case SQLITE_BLOB:
+        con->_post_handler(std::bind(handler, ec));
+    });
+}
+
+sqlite::native_handle_type sqlite::native_handle() const
+{
+    return _private->db;
+}
+
+void sqlite::set_statement_cache_capacity(std::size_t capacity)
+{
+    _private->cache->set_capacity(capacity);
+}
+
+sqlite_statement_cache_stats sqlite::statement_cache_stats() const
+{
+    return _private->cache->stats();
+}
+
+void sqlite::set_statement_stats_enabled(bool enabled)
+{
+    auto& reg = _private->stats_registry;
+    if (!enabled)
+        reg.reset();
+    else if (!reg)
+        reg = std::make_shared<detail::sqlite_stats_registry>();
+}
+
+std::vector<std::pair<string, sqlite_statement_stats>>
+sqlite::statement_stats() const
+{
+    const auto& reg = _private->stats_registry;
+    if (!reg) return {};
+    return reg->snapshot();
+}
+
+sqlite_service::sqlite_service(io_service& ios)
+    : super_type{ios}
+    , _my_ios{std::thread::hardware_concurrency() * 2}
+    , _workptr{new io_service::work{_my_ios}}
+{
+}
+
+sqlite_service::~sqlite_service()
+{
+    _workptr.reset();
+    _my_ios.stop();
+    for (auto& t : _threads) t.join();
+}
+
+void sqlite_service::_ensure_threads_started()
+{
+    std::call_once(_start_threads_flag, [this] {
+        _threads.resize(std::thread::hardware_concurrency());
+        for (auto& t : _threads) t = std::thread{[this] { _my_ios.run(); }};
+        _thread_count = _threads.size();
+    });
+}
+
+namespace
+{
+
+const char* const op_kind_names[] = {
+    "open",
+    "prepare",
+    "execute",
+    "step",
+    "other",
+};
+
+string span_name(sqlite_op_kind kind, const char* phase)
+{
+    return string{op_kind_names[static_cast<std::size_t>(kind)]} + ": "
+           + phase;
+}
+
+/// The traced task running on this thread
+struct traced_task
+{
+    const std::shared_ptr<timeline>* tl = nullptr;
+    std::uint64_t id = 0;
+    sqlite_op_kind kind = sqlite_op_kind::other;
+};
+thread_local traced_task current_task;
+
+} /* anonymous namespace */
+
+void sqlite_service::_post(io_service::strand& lane,
+                           std::function<void()> task,
+                           sqlite_op_kind kind)
+{
+    _ensure_threads_started();
+    const auto metrics = _metrics_enabled.load(std::memory_order_relaxed);
+    std::shared_ptr<timeline> tl;
+    if (_tracing.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lk{_timeline_mutex};
+        tl = _timeline;
+    }
+    if (!metrics && !tl)
+    {
+        lane.post(std::move(task));
+        return;
+    }
+    using clock = std::chrono::steady_clock;
+    const auto id = tl ? tl->new_id() : 0;
+    if (metrics) ++_queued;
+    const auto queued = clock::now();
+    lane.post([
+        this,
+        kind,
+        metrics,
+        tl,
+        id,
+        queued,
+        task = std::move(task)
+    ] {
+        if (metrics)
         {
-            const auto ptr
-                = reinterpret_cast<const char*>(::sqlite3_column_blob(pst, i));
-            const auto len = ::sqlite3_column_bytes(pst, i);
-            std::vector<char> data{ptr, ptr + len};
-            values.emplace_back(std::move(data));
-            break;
+            --_queued;
+            ++_busy;
         }
-        case SQLITE_NULL:
-            values.emplace_back(nullptr);
-            break;
-        default:
-            assert(0);
+        const auto started = clock::now();
+        const auto outer = current_task;
+        current_task = traced_task{tl ? &tl : nullptr, id, kind};
+        task();
+        current_task = outer;
+        const auto finished = clock::now();
+        if (tl)
+        {
+            tl->record({span_name(kind, "queued"), id, 0, queued, started});
+            tl->record({span_name(kind, "run"),
+                        id,
+                        timeline::this_thread_id(),
+                        started,
+                        finished});
         }
+        if (!metrics) return;
+        --_busy;
+        auto& m = _op_metrics[static_cast<std::size_t>(kind)];
+        m.queue_wait.record(started - queued);
+        m.run_time.record(finished - started);
+        m.latency.record(finished - queued);
+    });
+    if (tl)
+    {
+        tl->record({span_name(kind, "call"),
+                    id,
+                    timeline::this_thread_id(),
+                    queued,
+                    clock::now()});
     }
+}
 
-    return row{std::move(values)};
+std::shared_ptr<detail::sqlite_handler_trace>
+sqlite_service::_current_handler_trace()
+{
+    if (!current_task.tl) return nullptr;
+    return std::make_shared<sqlite_handler_trace>(
+        sqlite_handler_trace{*current_task.tl,
+                             current_task.id,
+                             current_task.kind,
+                             timeline::clock::now()});
 }
 
-void sqlite_statement::bind(int index, const value& value)
+void detail::sqlite_handler_trace::ran(
+    timeline::clock::time_point started) const
 {
-    const auto pst = _private->st;
-    int rc = SQLITE_OK;
-    switch (value.get_type())
+    tl->record({span_name(kind, "handler queued"), id, 0, posted, started});
+    tl->record({span_name(kind, "handler"),
+                id,
+                timeline::this_thread_id(),
+                started,
+                timeline::clock::now()});
+}
+
+void sqlite_service::set_timeline(std::shared_ptr<timeline> tl)
+{
+    std::lock_guard<std::mutex> lk{_timeline_mutex};
+    _tracing = !!tl;
+    _timeline = std::move(tl);
+}
+
+sqlite_service_metrics sqlite_service::metrics() const
+{
+    sqlite_service_metrics ret;
+    for (auto i = 0u; i < sqlite_op_kind_count; ++i)
     {
-    case type::null_t:
-        rc = ::sqlite3_bind_null(pst, index);
-        break;
-    case type::integer:
-        rc = ::sqlite3_bind_int64(pst, index, value.get<value::integer>());
-        break;
-    case type::real:
-        rc = ::sqlite3_bind_double(pst, index, value.get<value::real>());
-        break;
-    case type::text:
+        ret.ops[i].queue_wait = _op_metrics[i].queue_wait.snapshot();
+        ret.ops[i].run_time = _op_metrics[i].run_time.snapshot();
+        ret.ops[i].latency = _op_metrics[i].latency.snapshot();
+    }
+    ret.queue_depth = _queued;
+    ret.busy_workers = _busy;
+    ret.threads = _thread_count;
+    return ret;
+}
+
+void sqlite_service::reset_metrics()
+{
+    for (auto& m : _op_metrics)
     {
-        const auto& str = value.get<value::text>();
-        rc = ::sqlite3_bind_text(pst,
-                                 index,
-                                 str.data(),
-                                 str.size(),
-                                 SQLITE_TRANSIENT);
-        break;
+        m.queue_wait.reset();
+        m.run_time.reset();
+        m.latency.reset();
     }
-    case type::blob:
+}
+
+void sqlite::_start_task(std::function<void()> task, sqlite_op_kind kind)
+{
+    _service.get()._post(_private->strand, std::move(task), kind);
+}
+
+namespace
+{
+
+void write_gauge(std::ostream& out,
+                 const string& name,
+                 const char* help,
+                 std::size_t value)
+{
+    out << "# HELP " << name << ' ' << help << '\n';
+    out << "# TYPE " << name << " gauge\n";
+    out << name << ' ' << value << '\n';
+}
+
+void write_summary(std::ostream& out,
+                   const string& name,
+                   const char* help,
+                   const sqlite_service_metrics& metrics,
+                   histogram_snapshot sqlite_op_metrics::*timing)
+{
+    const auto seconds = [](std::chrono::nanoseconds ns) {
+        return std::chrono::duration<double>(ns).count();
+    };
+    out << "# HELP " << name << ' ' << help << '\n';
+    out << "# TYPE " << name << " summary\n";
+    for (auto i = 0u; i < sqlite_op_kind_count; ++i)
     {
-        const auto& bytes = value.get<value::blob>();
-        rc = ::sqlite3_bind_blob(pst,
-                                 index,
-                                 bytes.data(),
-                                 bytes.size(),
-                                 SQLITE_TRANSIENT);
-        break;
+        const auto& hist = metrics.ops[i].*timing;
+        const auto op = string{"op=\""} + op_kind_names[i] + '"';
+        for (const auto q : {0.5, 0.9, 0.99, 0.999})
+        {
+            out << name << '{' << op << ",quantile=\"" << q << "\"} "
+                << seconds(hist.percentile(q)) << '\n';
+        }
+        out << name << "_sum{" << op << "} " << seconds(hist.sum()) << '\n';
+        out << name << "_count{" << op << "} " << hist.count() << '\n';
     }
-    case type::datetime:
+}
+
+} /* anonymous namespace */
+
+string sqlite_service_metrics::to_prometheus(const string& prefix) const
+{
+    std::ostringstream out;
+    out.imbue(std::locale::classic());
+    out.precision(9);
+    write_gauge(out,
+                prefix + "_queue_depth",
+                "Tasks waiting for a worker thread",
+                queue_depth);
+    write_gauge(out,
+                prefix + "_busy_workers",
+                "Worker threads running a task",
+                busy_workers);
+    write_gauge(out, prefix + "_threads", "Worker threads", threads);
+    write_summary(out,
+                  prefix + "_queue_wait_seconds",
+                  "Time from queueing a task to starting it",
+                  *this,
+                  &sqlite_op_metrics::queue_wait);
+    write_summary(out,
+                  prefix + "_run_seconds",
+                  "Time spent running a task",
+                  *this,
+                  &sqlite_op_metrics::run_time);
+    write_summary(out,
+                  prefix + "_latency_seconds",
+                  "Time from queueing a task to finishing it",
+                  *this,
+                  &sqlite_op_metrics::latency);
+    return out.str();
+}
+
+namespace
+{
+
+bool is_busy(const error_code& ec)
+{
+    if (ec.category() != sqlite_category()) return false;
+    // Compare the primary result code, ignoring the extended code bits
+    const auto primary = ec.value() & 0xff;
+    return primary == SQLITE_BUSY || primary == SQLITE_LOCKED;
+}
+
+std::chrono::steady_clock::duration
+retry_delay(const sqlite_retry_policy& retry, std::size_t n)
+{
+    using duration = std::chrono::steady_clock::duration;
+    auto delay = double(retry.initial_delay.count())
+                 * std::pow(retry.multiplier, double(n));
+    delay = std::min(delay, double(retry.max_delay.count()));
+    if (retry.jitter)
     {
-        const value::integer time
-            = value.get<value::datetime>().time_since_epoch().count();
-        rc = ::sqlite3_bind_int64(pst, index, time);
-        break;
+        static thread_local std::minstd_rand rng{std::random_device{}()};
+        std::uniform_real_distribution<double> dist{0.5, 1.0};
+        delay *= dist(rng);
     }
+    return duration{static_cast<duration::rep>(delay)};
+}
+
+} /* anonymous namespace */
+
+void sqlite::_push_op(sqlite_op_kind kind,
+                      const sqlite_op_options& opts,
+                      std::function<error_code()> attempt,
+                      std::function<void(error_code)> done)
+{
+    auto state = std::make_shared<detail::sqlite_op_state>(
+        _service.get()._my_ios,
+        _private->generation.load(),
+        opts.retry ? *opts.retry : _retry_policy,
+        opts,
+        std::move(attempt),
+        std::move(done));
+    const auto raw = state.get();
+    state->run = [ this_pin = shared_from_this(), this, raw ]
+    {
+        const auto interrupted = make_error_code(sqlite_errc::interrupt);
+        const auto now = std::chrono::steady_clock::now();
+        if (raw->generation != _private->generation.load()
+            || (raw->deadline && now >= *raw->deadline))
+        {
+            raw->done(interrupted);
+            return;
+        }
+        _private->current_op.store(raw, std::memory_order_release);
+        const auto ec = raw->attempt();
+        _private->current_op.store(nullptr, std::memory_order_release);
+        const auto retriable = is_busy(ec) && _private->db
+                               && ::sqlite3_get_autocommit(_private->db);
+        if (!retriable || raw->retries == raw->retry.max_retries)
+        {
+            raw->done(ec);
+            return;
+        }
+        auto wake = std::chrono::steady_clock::now()
+                    + retry_delay(raw->retry, raw->retries++);
+        if (raw->deadline && *raw->deadline < wake) wake = *raw->deadline;
+        raw->timer.expires_at(wake);
+        // The operation doesn't hold the connection's lane while it waits.
+        // It is resumed on the lane, where cancel() can also reach it.
+        auto& waiting = _private->waiting;
+        waiting.erase(std::remove_if(waiting.begin(),
+                                     waiting.end(),
+                                     [](const std::weak_ptr<
+                                         detail::sqlite_op_state>& w) {
+                                         return w.expired();
+                                     }),
+                      waiting.end());
+        waiting.push_back(raw->shared_from_this());
+        auto resume = [state = raw->shared_from_this()](error_code)
+        {
+            state->run();
+        };
+        raw->timer.async_wait(_private->strand.wrap(resume));
+    };
+    _start_task([state] { state->run(); }, kind);
+}
+
+void sqlite::_push_grouped(const sqlite_op_options& opts,
+                           statement& st,
+                           std::function<void(error_code)> done)
+{
+    const auto group_opts = *_group_commit;
+    // Set when the write has joined the group, which then owns ``done``
+    auto joined = std::make_shared<bool>(false);
+    auto attempt = [ this, st_ref = std::ref(st), group_opts, joined, done ]
+    {
+        auto& priv = *_private;
+        error_code ec;
+        // Reads never wait for the group's commit, and writes inside the
+        // user's own transaction don't start a group
+        if (st_ref.get().readonly()
+            || (!priv.group_open
+                && (!priv.db || !::sqlite3_get_autocommit(priv.db))))
+        {
+            execute(st_ref.get(), ec);
+            return ec;
+        }
+        if (!priv.group_open)
+        {
+            ec = run_control(priv, begin_immediate);
+            if (ec) return ec;
+            priv.group_open = true;
+            const auto number = ++priv.group_number;
+            priv.group_timer.expires_from_now(group_opts.window);
+            priv.group_timer.async_wait(priv.strand.wrap([
+                this_pin = shared_from_this(),
+                this,
+                number
+            ](error_code) {
+                if (_private->group_number == number) _commit_group();
+            }));
+        }
+        ec = run_control(priv, group_savepoint);
+        if (ec) return ec;
+        execute(st_ref.get(), ec);
+        if (ec)
+        {
+            run_control(priv, group_rollback_to);
+            run_control(priv, group_release);
+            if (::sqlite3_get_autocommit(priv.db))
+            {
+                // Some errors make SQLite roll back the whole transaction,
+                // taking the rest of the group with it
+                priv.group_open = false;
+                ++priv.group_number;
+                auto writes = std::move(priv.group_writes);
+                priv.group_writes.clear();
+                for (auto& w : writes) w(ec);
+            }
+            return ec;
+        }
+        ec = run_control(priv, group_release);
+        if (ec) return ec;
+        *joined = true;
+        priv.group_writes.push_back(done);
+        if (priv.group_writes.size() >= group_opts.max_writes) _commit_group();
+        return ec;
+    };
+    _push_op(sqlite_op_kind::execute,
+             opts,
+             attempt,
+             [joined, done](error_code ec) {
+                 if (!*joined) done(ec);
+             });
+}
+
+void sqlite::_commit_group()
+{
+    auto& priv = *_private;
+    if (!priv.group_open) return;
+    priv.group_open = false;
+    ++priv.group_number;
+    priv.group_timer.cancel();
+    // The group's writes have all completed, so the commit must not be
+    // interrupted by the cancellation of whichever operation triggered it
+    const auto op = priv.current_op.exchange(nullptr);
+    const auto ec = run_control(priv, commit_transaction);
+    if (ec) run_control(priv, rollback_transaction);
+    priv.current_op.store(op);
+    auto writes = std::move(priv.group_writes);
+    priv.group_writes.clear();
+    for (auto& w : writes) w(ec);
+}
+
+bool sqlite::_refuse_in_group(error_code& ec) const
+{
+    if (!_private->group_open.load()
+        || _private->strand.running_in_this_thread())
+        return false;
+    ec = make_error_code(adio::sys_errc::operation_in_progress);
+    return true;
+}
+
+void sqlite::cancel()
+{
+    ++_private->generation;
+    // Wake operations waiting to retry, so that they complete right away
+    _start_task([ this_pin = shared_from_this(), this ] {
+        for (auto& w : _private->waiting)
+        {
+            if (auto op = w.lock()) op->timer.cancel();
+        }
+        _private->waiting.clear();
+    });
+}
+
+namespace
+{
+
+bool is_busy_result(int rc)
+{
+    return rc == SQLITE_BUSY || rc == SQLITE_LOCKED;
+}
+
+/// The error a backup that ended with ``rc`` completes with
+error_code backup_error(int rc)
+{
+    if (rc == SQLITE_OK) return {};
+    // A backup that ran out of retries reports the database as busy, even
+    // if it was locked by a connection sharing its cache
+    if (is_busy_result(rc)) rc = SQLITE_BUSY;
+    return make_error_code(static_cast<sqlite_errc>(rc));
+}
+
+/// A backup in progress, along with the destination database if it was
+/// opened for the backup
+struct backup_state : std::enable_shared_from_this<backup_state>
+{
+    backup_state(io_service& ios, const sqlite_backup_options& opts_)
+        : opts(opts_)
+        , timer(ios)
+    {
+    }
+
+    ~backup_state()
+    {
+        if (backup) ::sqlite3_backup_finish(backup);
+        if (owned_dest) ::sqlite3_close_v2(owned_dest);
+    }
+
+    /// Open the destination and start the backup
+    error_code init(::sqlite3* src, ::sqlite3* dest, const string& dest_path)
+    {
+        // An empty path means the destination connection wasn't open
+        if (!src || (!dest && dest_path.empty()))
+            return make_error_code(adio::sys_errc::not_connected);
+        if (!dest)
+        {
+            const auto rc = ::sqlite3_open_v2(
+                dest_path.data(),
+                &owned_dest,
+                SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE
+                    | SQLITE_OPEN_NOMUTEX,
+                nullptr);
+            if (rc != SQLITE_OK)
+                return make_error_code(static_cast<sqlite_errc>(rc));
+            dest = owned_dest;
+        }
+        backup = ::sqlite3_backup_init(dest, "main", src, "main");
+        if (backup) return {};
+        return make_error_code(
+            static_cast<sqlite_errc>(::sqlite3_errcode(dest)));
+    }
+
+    /// Copy the next pages. Returns SQLITE_OK if there are more to copy.
+    int step()
+    {
+        const auto rc = ::sqlite3_backup_step(backup, opts.pages_per_step);
+        busy_retries = is_busy_result(rc) ? busy_retries + 1 : 0;
+        return rc;
+    }
+
+    /// Whether a step that returned ``rc`` should be tried again
+    bool retry(int rc) const
+    {
+        return is_busy_result(rc) && busy_retries <= opts.max_busy_retries;
+    }
+
+    /// Finish the backup, returning the error it ended with, if any
+    int finish()
+    {
+        const auto rc = ::sqlite3_backup_finish(backup);
+        backup = nullptr;
+        return rc;
+    }
+
+    sqlite_backup_progress progress() const
+    {
+        return {std::size_t(::sqlite3_backup_remaining(backup)),
+                std::size_t(::sqlite3_backup_pagecount(backup))};
+    }
+
+    const sqlite_backup_options opts;
+    std::size_t busy_retries = 0;
+    ::sqlite3_backup* backup = nullptr;
+    ::sqlite3* owned_dest = nullptr;
+    asio::steady_timer timer;
+    std::function<void()> next;
+};
+
+} /* anonymous namespace */
+
+void sqlite::_backup(::sqlite3* dest,
+                     const string& dest_path,
+                     const sqlite_backup_options& opts,
+                     error_code& ec)
+{
+    if (_refuse_in_group(ec)) return;
+    backup_state state{_service.get()._my_ios, opts};
+    ec = state.init(_private->db, dest, dest_path);
+    if (ec) return;
+    auto rc = SQLITE_OK;
+    while (rc == SQLITE_OK)
+    {
+        rc = state.step();
+        if (state.retry(rc))
+        {
+            std::this_thread::sleep_for(opts.busy_delay);
+            rc = SQLITE_OK;
+        }
+    }
+    if (rc == SQLITE_DONE) rc = state.finish();
+    ec = backup_error(rc);
+}
+
+void sqlite::_start_backup(::sqlite3* dest,
+                           const string& dest_path,
+                           const sqlite_backup_options& opts,
+                           std::function<void(sqlite_backup_progress)> progress,
+                           std::function<void(error_code)> done)
+{
+    auto state = std::make_shared<backup_state>(_service.get()._my_ios, opts);
+    const auto generation = _private->generation.load();
+    const auto raw = state.get();
+    // Holds only a raw pointer to the state, which owns it. Each pending
+    // step holds a strong one, so the state lives until the last step.
+    raw->next = [
+        this_pin = shared_from_this(),
+        this,
+        raw,
+        generation,
+        dest,
+        dest_path,
+        progress,
+        done
+    ]
+    {
+        auto& state = *raw;
+        auto finish = [&](int rc) {
+            if (rc == SQLITE_DONE) rc = state.finish();
+            done(backup_error(rc));
+        };
+        if (generation != _private->generation.load())
+        {
+            finish(SQLITE_INTERRUPT);
+            return;
+        }
+        if (!state.backup)
+        {
+            const auto ec = state.init(_private->db, dest, dest_path);
+            if (ec)
+            {
+                done(ec);
+                return;
+            }
+        }
+        const auto rc = state.step();
+        if (rc != SQLITE_OK && !state.retry(rc))
+        {
+            if (rc == SQLITE_DONE) progress(state.progress());
+            finish(rc);
+            return;
+        }
+        progress(state.progress());
+        const auto& opts = state.opts;
+        const auto delay
+            = is_busy_result(rc) ? opts.busy_delay : opts.step_delay;
+        auto again = [pin = raw->shared_from_this()] { pin->next(); };
+        if (delay == delay.zero())
+        {
+            // Yield the connection's lane to any operations queued behind us
+            _private->strand.post(again);
+            return;
+        }
+        state.timer.expires_from_now(delay);
+        state.timer.async_wait(
+            _private->strand.wrap([again](error_code) { again(); }));
+    };
+    _start_task([state] { state->next(); });
+}
+
+row sqlite_statement::current_row() const { return current_view().to_row(); }
+
+sqlite_statement::row_view sqlite_statement::current_view() const
+{
+    return row_view{_private->st};
+}
+
+std::size_t detail::sqlite_row_view::size() const
+{
+    return static_cast<std::size_t>(::sqlite3_column_count(_st));
+}
+
+adio::type detail::sqlite_row_view::column_type(std::size_t col) const
+{
+    switch (::sqlite3_column_type(_st, int(col)))
+    {
+    case SQLITE_INTEGER:
+        return type::integer;
+    case SQLITE_FLOAT:
+        return type::real;
+    case SQLITE_TEXT:
+        return type::text;
+    case SQLITE_BLOB:
+        return type::blob;
+    case SQLITE_NULL:
+        return type::null_t;
+    default:
+        assert(0);
+        std::terminate();
+    }
+}
+
+bool detail::sqlite_row_view::is_null(std::size_t col) const
+{
+    return ::sqlite3_column_type(_st, int(col)) == SQLITE_NULL;
+}
+
+string_view detail::sqlite_row_view::column_name(std::size_t col) const
+{
+    const auto name = ::sqlite3_column_name(_st, int(col));
+    return name ? string_view{name} : string_view{};
+}
+
+value::integer detail::sqlite_row_view::integer(std::size_t col) const
+{
+    return ::sqlite3_column_int64(_st, int(col));
+}
+
+value::real detail::sqlite_row_view::real(std::size_t col) const
+{
+    return ::sqlite3_column_double(_st, int(col));
+}
+
+string_view detail::sqlite_row_view::text(std::size_t col) const
+{
+    // Get the pointer first: it may convert the value, changing its size
+    const auto ptr
+        = reinterpret_cast<const char*>(::sqlite3_column_text(_st, int(col)));
+    const auto len = ::sqlite3_column_bytes(_st, int(col));
+    return {ptr, static_cast<std::size_t>(len)};
+}
+
+blob_view detail::sqlite_row_view::blob(std::size_t col) const
+{
+    const auto ptr = ::sqlite3_column_blob(_st, int(col));
+    const auto len = ::sqlite3_column_bytes(_st, int(col));
+    return {ptr, static_cast<std::size_t>(len)};
+}
+
+value detail::sqlite_row_view::operator[](std::size_t col) const
+{
+    switch (column_type(col))
+    {
+    case type::integer:
+        return value{integer(col)};
+    case type::real:
+        return value{real(col)};
+    case type::text:
+        return value{text(col).to_string()};
+    case type::blob:
+    {
+        const auto data = blob(col);
+        return value{value::blob(data.begin(), data.end())};
+    }
+    case type::null_t:
+        return value{null};
     default:
         assert(0);
         std::terminate();
     }
+}
+
+row detail::sqlite_row_view::to_row() const
+{
+    const auto num_columns = size();
+    std::vector<adio::value> values;
+    values.reserve(num_columns);
+    for (auto i = 0u; i < num_columns; ++i) values.push_back((*this)[i]);
+    return row{std::move(values)};
+}
+
+namespace
+{
+
+void check_bind_result(int rc)
+{
     switch (rc)
     {
     case SQLITE_NOMEM:
@@ -319,12 +1946,94 @@ void sqlite_statement::bind(int index, const value& value)
     }
 }
 
-void sqlite_statement::bind(const std::string& name, const value& value)
+::sqlite3_destructor_type destructor_for(bind_mode mode)
+{
+    return mode == bind_mode::borrow ? SQLITE_STATIC : SQLITE_TRANSIENT;
+}
+
+} /* anonymous namespace */
+
+void sqlite_statement::bind(int index, const value& value)
+{
+    switch (value.get_type())
+    {
+    case type::null_t:
+        return bind_null(index);
+    case type::integer:
+        return bind_integer(index, value.get<value::integer>());
+    case type::real:
+        return bind_real(index, value.get<value::real>());
+    case type::text:
+    {
+        const auto& str = value.get<value::text>();
+        return bind_text(index, str);
+    }
+    case type::blob:
+    {
+        const auto& bytes = value.get<value::blob>();
+        return bind_blob(index, bytes);
+    }
+    case type::datetime:
+    {
+        const value::integer time
+            = value.get<value::datetime>().time_since_epoch().count();
+        return bind_integer(index, time);
+    }
+    default:
+        assert(0);
+        std::terminate();
+    }
+}
+
+void sqlite_statement::bind_null(int index)
+{
+    check_bind_result(::sqlite3_bind_null(_private->st, index));
+}
+
+void sqlite_statement::bind_integer(int index, value::integer i)
+{
+    check_bind_result(::sqlite3_bind_int64(_private->st, index, i));
+}
+
+void sqlite_statement::bind_real(int index, value::real r)
+{
+    check_bind_result(::sqlite3_bind_double(_private->st, index, r));
+}
+
+void sqlite_statement::bind_text(int index, string_view text, bind_mode mode)
+{
+    if (text.size() > std::size_t(std::numeric_limits<int>::max()))
+        check_bind_result(SQLITE_TOOBIG);
+    // A null data pointer would bind NULL rather than an empty string
+    const auto data = text.data() ? text.data() : "";
+    check_bind_result(::sqlite3_bind_text(_private->st,
+                                          index,
+                                          data,
+                                          int(text.size()),
+                                          destructor_for(mode)));
+}
+
+void sqlite_statement::bind_blob(int index, blob_view data, bind_mode mode)
+{
+    if (data.size() > std::size_t(std::numeric_limits<int>::max()))
+        check_bind_result(SQLITE_TOOBIG);
+    const auto ptr = data.data() ? data.data() : "";
+    check_bind_result(::sqlite3_bind_blob(_private->st,
+                                          index,
+                                          ptr,
+                                          int(data.size()),
+                                          destructor_for(mode)));
+}
+
+int sqlite_statement::parameter_index(string_view name) const
+{
+    return _private->param_index(name);
+}
+
+void sqlite_statement::bind(string_view name, const value& value)
 {
-    auto nparam = ::sqlite3_bind_parameter_count(_private->st);
-    assert(nparam > 0);
-    const auto index
-        = ::sqlite3_bind_parameter_index(_private->st, name.data());
-    if (index == 0) throw std::domain_error{"No such parameter: " + name};
+    const auto index = parameter_index(name);
+    if (index == 0)
+        throw std::domain_error{"No such parameter: " + name.to_string()};
     bind(index, value);
 }
@@ -4,12 +4,29 @@
 #include <adio/connection_fwd.hpp>
 #include <adio/service.hpp>
 #include <adio/error.hpp>
+#include <adio/histogram.hpp>
+#include <adio/sql/columns.hpp>
 #include <adio/sql/row.hpp>
+#include <adio/sql/view.hpp>
+#include <adio/timeline.hpp>
 #include <adio/utils.hpp>
 
+#include <boost/optional.hpp>
+
+#include <chrono>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
 #include <future>
+#include <iterator>
 #include <memory>
 #include <string>
+#include <thread>
+#include <vector>
+
+struct sqlite3;
+struct sqlite3_stmt;
 
 namespace adio
 {
@@ -117,6 +134,128 @@ inline error_condition make_error_condition(sqlite_errc e)
     return {static_cast<int>(e), sqlite_category()};
 }
 
+/// Counters for a connection's prepared statement cache
+struct sqlite_statement_cache_stats
+{
+    /// Number of prepares satisfied by a cached statement
+    std::size_t hits;
+    /// Number of prepares that had to compile their SQL
+    std::size_t misses;
+    /// Number of idle statements currently held in the cache
+    std::size_t size;
+    /// Maximum number of idle statements held in the cache
+    std::size_t capacity;
+};
+
+/// Counters of the work done by a prepared statement
+struct sqlite_statement_stats
+{
+    /// Rows stepped through by full table scans. Many of these usually mean
+    /// an index is missing.
+    std::uint64_t fullscan_steps = 0;
+    /// Sort operations
+    std::uint64_t sorts = 0;
+    /// Rows inserted into automatic indexes, which SQLite builds when no
+    /// suitable index exists
+    std::uint64_t autoindexes = 0;
+    /// Virtual machine steps. Zero with SQLite older than 3.10.
+    std::uint64_t vm_steps = 0;
+    /// Recompilations after schema changes. Zero with SQLite older than 3.20.
+    std::uint64_t reprepares = 0;
+    /// The number of times the statement was run
+    std::uint64_t runs = 0;
+    /// Time spent in ``sqlite3_step``. Only measured while statement
+    /// statistics are enabled on the connection.
+    std::chrono::nanoseconds step_time{0};
+
+    sqlite_statement_stats& operator+=(const sqlite_statement_stats& other)
+    {
+        fullscan_steps += other.fullscan_steps;
+        sorts += other.sorts;
+        autoindexes += other.autoindexes;
+        vm_steps += other.vm_steps;
+        reprepares += other.reprepares;
+        runs += other.runs;
+        step_time += other.step_time;
+        return *this;
+    }
+};
+
+/// SQLite journal modes. See ``PRAGMA journal_mode``.
+enum class sqlite_journal_mode
+{
+    /// Keep the database's current journal mode
+    unchanged,
+    delete_,
+    truncate,
+    persist,
+    memory,
+    wal,
+    off,
+};
+
+/// SQLite synchronous levels. See ``PRAGMA synchronous``.
+enum class sqlite_synchronous
+{
+    /// Keep SQLite's default
+    unchanged,
+    off,
+    normal,
+    full,
+    extra,
+};
+
+/// Storage for temporary tables and indices. See ``PRAGMA temp_store``.
+enum class sqlite_temp_store
+{
+    /// Keep SQLite's default
+    unchanged,
+    default_,
+    file,
+    memory,
+};
+
+/**
+ * Options for opening a SQLite database.
+ *
+ * Every option that is set is applied before ``open()`` returns (or before
+ * the ``async_open()`` handler is invoked), so the connection is never handed
+ * out in a half-configured state. If any of them fails, the database is
+ * closed again and the error is returned.
+ */
+struct sqlite_open_options
+{
+    /// ``SQLITE_OPEN_*`` flags passed to ``sqlite3_open_v2``. Zero means
+    /// ``SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE``.
+    /// ``SQLITE_OPEN_FULLMUTEX`` is always added unless
+    /// ``SQLITE_OPEN_NOMUTEX`` is given. See ``sqlite`` before passing that.
+    int flags = 0;
+    /// If the database cannot be switched to this mode, opening fails
+    sqlite_journal_mode journal_mode = sqlite_journal_mode::unchanged;
+    sqlite_synchronous synchronous = sqlite_synchronous::unchanged;
+    sqlite_temp_store temp_store = sqlite_temp_store::unchanged;
+    /// Maximum bytes of the database to memory-map (``PRAGMA mmap_size``)
+    boost::optional<std::int64_t> mmap_size;
+    /// Page cache size (``PRAGMA cache_size``): pages if positive, KiB if
+    /// negative
+    boost::optional<std::int64_t> cache_size;
+    /// How long to wait on a locked database before failing with
+    /// ``sqlite_errc::busy``
+    boost::optional<std::chrono::milliseconds> busy_timeout;
+    /// Maximum auxiliary threads per statement (``PRAGMA threads``)
+    boost::optional<int> threads;
+};
+
+/// How text and blob parameters are handed to SQLite
+enum class bind_mode
+{
+    /// SQLite copies the data when it is bound
+    copy,
+    /// SQLite refers to the caller's data, which must stay valid and
+    /// unchanged until the statement is reset, rebound or destroyed
+    borrow,
+};
+
 namespace detail
 {
 
@@ -125,14 +264,176 @@ struct sqlite_private;
 class sqlite_statement_private;
 class sqlite_statement;
 
+/**
+ * A non-owning view of the current result row of a statement.
+ *
+ * Values are read straight out of SQLite without being copied. The view, and
+ * any ``string_view`` or ``blob_view`` obtained from it, is only valid until
+ * the statement is stepped, reset, or destroyed.
+ */
+class sqlite_row_view
+{
+    ::sqlite3_stmt* _st;
+
+public:
+    explicit sqlite_row_view(::sqlite3_stmt* st)
+        : _st{st}
+    {
+    }
+
+    /// The number of columns in the row
+    std::size_t size() const;
+    /// The type of the value in the given column
+    adio::type column_type(std::size_t col) const;
+    bool is_null(std::size_t col) const;
+    /// The name of the given column
+    string_view column_name(std::size_t col) const;
+
+    value::integer integer(std::size_t col) const;
+    value::real real(std::size_t col) const;
+    string_view text(std::size_t col) const;
+    blob_view blob(std::size_t col) const;
+
+    /// Copy a single column into a ``value``
+    value operator[](std::size_t col) const;
+    /// Copy the entire row
+    adio::row to_row() const;
+};
+
+/**
+ * Reads a single column of a row view as a ``T``, without going through
+ * ``adio::value``. Specialized for integers, floating point types,
+ * ``std::string``, ``string_view``, ``blob_view``, ``std::vector<char>``,
+ * ``adio::value`` and ``boost::optional`` of any of these. Only
+ * ``boost::optional`` and ``adio::value`` accept NULL.
+ */
+template <typename T, typename = void> struct sqlite_column_reader;
+
+inline void sqlite_check_not_null(const sqlite_row_view& v, std::size_t col)
+{
+    if (v.is_null(col))
+        throw invalid_access{"Cannot read NULL from column "
+                             + std::to_string(col)
+                             + " into a non-nullable type"};
+}
+
+template <typename T>
+struct sqlite_column_reader<
+    T,
+    typename std::enable_if<std::is_integral<T>::value>::type>
+{
+    static T read(const sqlite_row_view& v, std::size_t col)
+    {
+        sqlite_check_not_null(v, col);
+        return static_cast<T>(v.integer(col));
+    }
+};
+
+template <typename T>
+struct sqlite_column_reader<
+    T,
+    typename std::enable_if<std::is_floating_point<T>::value>::type>
+{
+    static T read(const sqlite_row_view& v, std::size_t col)
+    {
+        sqlite_check_not_null(v, col);
+        return static_cast<T>(v.real(col));
+    }
+};
+
+template <> struct sqlite_column_reader<string_view>
+{
+    static string_view read(const sqlite_row_view& v, std::size_t col)
+    {
+        sqlite_check_not_null(v, col);
+        return v.text(col);
+    }
+};
+
+#if __cplusplus >= 201703L
+template <> struct sqlite_column_reader<std::string_view>
+{
+    static std::string_view read(const sqlite_row_view& v, std::size_t col)
+    {
+        const auto str = sqlite_column_reader<string_view>::read(v, col);
+        return {str.data(), str.size()};
+    }
+};
+#endif
+
+template <> struct sqlite_column_reader<std::string>
+{
+    static std::string read(const sqlite_row_view& v, std::size_t col)
+    {
+        return sqlite_column_reader<string_view>::read(v, col).to_string();
+    }
+};
+
+template <> struct sqlite_column_reader<blob_view>
+{
+    static blob_view read(const sqlite_row_view& v, std::size_t col)
+    {
+        sqlite_check_not_null(v, col);
+        return v.blob(col);
+    }
+};
+
+template <> struct sqlite_column_reader<value::blob>
+{
+    static value::blob read(const sqlite_row_view& v, std::size_t col)
+    {
+        const auto data = sqlite_column_reader<blob_view>::read(v, col);
+        return value::blob(data.begin(), data.end());
+    }
+};
+
+template <> struct sqlite_column_reader<value>
+{
+    static value read(const sqlite_row_view& v, std::size_t col)
+    {
+        return v[col];
+    }
+};
+
+template <typename T> struct sqlite_column_reader<boost::optional<T>>
+{
+    static boost::optional<T> read(const sqlite_row_view& v, std::size_t col)
+    {
+        if (v.is_null(col)) return boost::none;
+        return sqlite_column_reader<T>::read(v, col);
+    }
+};
+
+/**
+ * Binds a ``T`` to a statement parameter without going through
+ * ``adio::value`` where possible. ``string_view`` and ``blob_view`` arguments
+ * are borrowed, while owning strings and vectors are copied.
+ */
+template <typename T, typename = void> struct sqlite_param_binder;
+
+template <typename Tuple, std::size_t... Is>
+void sqlite_read_tuple(const sqlite_row_view& v, Tuple& out, seq<Is...>)
+{
+    using std::get;
+    int expand[] = {
+        0,
+        (get<Is>(out) = sqlite_column_reader<typename std::decay<decltype(
+                 get<Is>(out))>::type>::read(v, Is),
+         0)...};
+    (void)expand;
+}
+
 class sqlite_statement
 {
     std::shared_ptr<sqlite_statement_private> _private;
     friend class sqlite_row_iterator;
 
     bool _advance();
+    void _check_width(std::size_t) const;
 
     bool _done = false;
+    // The column count already verified by fetch()
+    mutable std::size_t _checked_width = 0;
 
 public:
     sqlite_statement();
@@ -144,40 +445,75 @@ public:
     sqlite_statement& operator=(const sqlite_statement&) = delete;
 
     using row = adio::row;
+    using row_view = sqlite_row_view;
 
     row current_row() const;
+    /// Get a view of the current row. See ``sqlite_row_view``.
+    row_view current_view() const;
+
+private:
+    row _current(tag<row>) const { return current_row(); }
+    row_view _current(tag<row_view>) const { return current_view(); }
 
-    class iterator : public std::iterator<std::input_iterator_tag, row>
+public:
+    template <typename Row>
+    class basic_iterator : public std::iterator<std::input_iterator_tag, Row>
     {
         std::reference_wrapper<sqlite_statement> _st;
         bool _is_end = false;
-        void _advance();
 
     public:
-        iterator(sqlite_statement& st, bool end)
+        basic_iterator(sqlite_statement& st, bool end)
             : _st{st}
             , _is_end{end}
         {
             if (!end) ++*this;
         }
 
-        iterator& operator++()
+        basic_iterator& operator++()
         {
             _is_end = _st.get()._advance();
             return *this;
         }
 
-        bool operator!=(const iterator& other)
+        bool operator!=(const basic_iterator& other)
         {
             return other._is_end != _is_end;
         }
 
-        row operator*() const { return _st.get().current_row(); }
+        Row operator*() const { return _st.get()._current(tag<Row>{}); }
     };
 
+    /// Iterates the result rows, copying each into an ``adio::row``
+    using iterator = basic_iterator<row>;
+    /// Iterates the result rows as views. Each view is only valid until the
+    /// iterator is advanced.
+    using view_iterator = basic_iterator<row_view>;
+
     iterator begin() { return {*this, false}; };
     iterator end() { return {*this, true}; }
 
+    struct view_range
+    {
+        view_iterator first;
+        view_iterator last;
+        view_iterator begin() const { return first; }
+        view_iterator end() const { return last; }
+    };
+
+    /** Iterate over the result rows without copying them.
+     *
+     * ~~~cpp
+     * for (auto row : st.views())
+     *     consume(row.text(0));
+     * ~~~
+     */
+    view_range views()
+    {
+        view_iterator first{*this, false};
+        return {first, view_iterator{*this, true}};
+    }
+
     void execute()
     {
         error_code ec;
@@ -186,20 +522,607 @@ public:
     }
     void execute(error_code& ec);
 
+    /** Step to the next row and decode it into a tuple.
+     *
+     * @param out A ``std::tuple``, ``std::pair`` or ``std::array`` with one
+     * element per result column. Each column is read with
+     * ``sqlite_column_reader``, straight from SQLite.
+     * @returns ``false`` once there are no more rows. It keeps returning
+     * ``false``, without running the statement again, until ``reset()`` is
+     * called.
+     *
+     * The number of columns is checked the first time the statement is
+     * fetched from. A NULL column throws ``invalid_access`` unless its element
+     * is a ``boost::optional`` or ``adio::value``. Text and blob views are
+     * only valid until the next fetch.
+     */
+    template <typename Tuple> bool fetch(Tuple& out)
+    {
+        if (_done || _advance()) return false;
+        constexpr auto width = std::tuple_size<Tuple>::value;
+        if (_checked_width != width) _check_width(width);
+        detail::sqlite_read_tuple(current_view(), out, gen_seq<width>{});
+        return true;
+    }
+    /// Fetch the next row as a ``Tuple``, or ``boost::none`` if there are no
+    /// more rows.
+    template <typename Tuple> boost::optional<Tuple> fetch()
+    {
+        Tuple t;
+        if (!fetch(t)) return boost::none;
+        return t;
+    }
+
+    /** Fetch up to ``max_rows`` result rows into column-major buffers.
+     *
+     * @param out Cleared, then filled with the rows. Its buffers are reused
+     * between calls, so repeated fetches into the same batch do not allocate
+     * once the buffers have grown.
+     * @param max_rows The maximum number of rows to fetch
+     * @returns The number of rows fetched. Fewer than ``max_rows`` rows are
+     * only returned at the end of the results, at which point ``done()``
+     * becomes ``true``.
+     *
+     * Each column is stored in the layout of its first non-NULL value (see
+     * ``column_buffer``). Later values of a different type are converted by
+     * SQLite.
+     */
+    std::size_t fetch_columns(column_batch& out, std::size_t max_rows)
+    {
+        error_code ec;
+        const auto n = fetch_columns(out, max_rows, ec);
+        detail::throw_if_error(ec, "Failed to fetch rows");
+        return n;
+    }
+    std::size_t
+    fetch_columns(column_batch& out, std::size_t max_rows, error_code& ec);
+
     void bind(int index, const value& value);
-    void bind(const std::string& name, const value& value);
+    /// Bind a value to a named parameter, including its prefix (eg.
+    /// ``":name"``)
+    void bind(string_view name, const value& value);
+
+    /** Get the index of a named parameter, or zero if there is no such
+     * parameter.
+     *
+     * The parameter names of a statement are looked up once, the first time
+     * any name is resolved, and kept in a sorted table for as long as the
+     * statement is compiled (including while it sits in the statement cache).
+     * Callers binding in a loop may also resolve the index once and use the
+     * index-based binds.
+     */
+    int parameter_index(string_view name) const;
+
+    /// @{
+    /// Bind a value of a specific type to the parameter at ``index``
+    void bind_null(int index);
+    void bind_integer(int index, value::integer i);
+    void bind_real(int index, value::real r);
+    void
+    bind_text(int index, string_view text, bind_mode mode = bind_mode::copy);
+    void bind_blob(int index, blob_view data, bind_mode mode = bind_mode::copy);
+    /// @}
+
+    /** Bind each argument to the parameter at its position, starting at one.
+     *
+     * Arguments are bound according to their C++ type, without constructing
+     * ``adio::value`` objects (see ``sqlite_param_binder``). ``string_view``
+     * and ``blob_view`` arguments are bound with ``bind_mode::borrow``, so
+     * the data they refer to must outlive the execution of the statement.
+     *
+     * ~~~cpp
+     * st.bind_all(id, adio::string_view{name}, adio::blob_view{payload});
+     * ~~~
+     */
+    template <typename... Args> void bind_all(const Args&... args)
+    {
+        _bind_all(gen_seq<sizeof...(Args)>{}, args...);
+    }
+
+private:
+    template <std::size_t... Is, typename... Args>
+    void _bind_all(seq<Is...>, const Args&... args)
+    {
+        int expand[] = {
+            0,
+            (sqlite_param_binder<Args>::bind(*this, int(Is + 1), args), 0)...};
+        (void)expand;
+    }
+
+public:
+
+    /** Reset the statement so that it can be executed or iterated again.
+     *
+     * Parameter bindings are kept. Use ``clear_bindings()`` to reset those as
+     * well.
+     */
+    void reset();
+    /// Set all bound parameters back to NULL
+    void clear_bindings();
 
     bool done() const { return _done; }
+
+    /// Whether the statement makes no direct changes to the database
+    bool readonly() const;
+
+    /// Get the work this statement has done since it was prepared (or taken
+    /// from the statement cache)
+    sqlite_statement_stats stats() const;
+
+    using native_handle_type = ::sqlite3_stmt*;
+    /// Get the underlying SQLite statement handle
+    native_handle_type native_handle() const;
 };
 
 class sqlite_service;
 
+template <typename T>
+struct sqlite_param_binder<
+    T,
+    typename std::enable_if<std::is_integral<T>::value>::type>
+{
+    static void bind(sqlite_statement& st, int index, T i)
+    {
+        st.bind_integer(index, static_cast<value::integer>(i));
+    }
+};
+
+template <typename T>
+struct sqlite_param_binder<
+    T,
+    typename std::enable_if<std::is_floating_point<T>::value>::type>
+{
+    static void bind(sqlite_statement& st, int index, T r)
+    {
+        st.bind_real(index, static_cast<value::real>(r));
+    }
+};
+
+template <> struct sqlite_param_binder<string_view>
+{
+    static void bind(sqlite_statement& st, int index, string_view str)
+    {
+        st.bind_text(index, str, bind_mode::borrow);
+    }
+};
+
+template <> struct sqlite_param_binder<std::string>
+{
+    static void bind(sqlite_statement& st, int index, const std::string& str)
+    {
+        st.bind_text(index, str);
+    }
+};
+
+template <> struct sqlite_param_binder<const char*>
+{
+    static void bind(sqlite_statement& st, int index, const char* str)
+    {
+        if (str)
+            st.bind_text(index, str);
+        else
+            st.bind_null(index);
+    }
+};
+
+template <std::size_t N> struct sqlite_param_binder<char[N]>
+{
+    static void bind(sqlite_statement& st, int index, const char* str)
+    {
+        st.bind_text(index, str);
+    }
+};
+
+template <> struct sqlite_param_binder<blob_view>
+{
+    static void bind(sqlite_statement& st, int index, blob_view data)
+    {
+        st.bind_blob(index, data, bind_mode::borrow);
+    }
+};
+
+template <> struct sqlite_param_binder<value::blob>
+{
+    static void bind(sqlite_statement& st, int index, const value::blob& data)
+    {
+        st.bind_blob(index, data);
+    }
+};
+
+template <> struct sqlite_param_binder<null_t>
+{
+    static void bind(sqlite_statement& st, int index, null_t)
+    {
+        st.bind_null(index);
+    }
+};
+
+template <> struct sqlite_param_binder<std::nullptr_t>
+{
+    static void bind(sqlite_statement& st, int index, std::nullptr_t)
+    {
+        st.bind_null(index);
+    }
+};
+
+template <> struct sqlite_param_binder<value>
+{
+    static void bind(sqlite_statement& st, int index, const value& v)
+    {
+        st.bind(index, v);
+    }
+};
+
+template <typename T> struct sqlite_param_binder<boost::optional<T>>
+{
+    static void
+    bind(sqlite_statement& st, int index, const boost::optional<T>& opt)
+    {
+        if (opt)
+            sqlite_param_binder<T>::bind(st, index, *opt);
+        else
+            st.bind_null(index);
+    }
+};
+
+/// Types with a ``value_adaptor`` are bound by converting them to ``value``
+template <typename T>
+struct sqlite_param_binder<
+    T,
+    typename std::enable_if<!std::is_arithmetic<T>::value
+                            && has_value_adaptor<T>::value>::type>
+{
+    static void bind(sqlite_statement& st, int index, const T& v)
+    {
+        st.bind(index, value{v});
+    }
+};
+
+/// Bind the columns of an ``adio::row`` to the parameters of a statement
+inline void bind_batch_row(sqlite_statement& st, const row& r)
+{
+    for (auto i = 0u; i < r.size(); ++i) st.bind(int(i + 1), r[i]);
+}
+
+template <typename Tuple, std::size_t... Is>
+void bind_batch_tuple(sqlite_statement& st, const Tuple& t, seq<Is...>)
+{
+    st.bind_all(std::get<Is>(t)...);
+}
+
+/// Bind the elements of a tuple to the parameters of a statement
+template <typename... Ts>
+void bind_batch_row(sqlite_statement& st, const std::tuple<Ts...>& t)
+{
+    bind_batch_tuple(st, t, gen_seq<sizeof...(Ts)>{});
+}
+
 } /* detail */
 
+/// Options for ``sqlite::execute_batch``
+struct sqlite_batch_options
+{
+    /// The number of rows to write in each transaction
+    std::size_t chunk_size = 1000;
+};
+
+/** How asynchronous operations retry when the database is busy.
+ *
+ * When an asynchronous operation fails with ``sqlite_errc::busy`` or
+ * ``sqlite_errc::locked`` (or an extended code of either) while no explicit
+ * transaction is open on the connection, it is attempted again after a delay.
+ * Unlike ``sqlite_open_options::busy_timeout``, the delay is spent on an Asio
+ * timer rather than sleeping in a service thread, so other connections'
+ * operations keep running in the meantime.
+ *
+ * The delay before retry ``n`` (counting from zero) is
+ * ``initial_delay * multiplier^n``, capped at ``max_delay``. With ``jitter``,
+ * each delay is scaled by a random factor between one half and one, so that
+ * contending connections don't retry in lockstep.
+ *
+ * Inside an explicit transaction, ``busy`` is reported right away: SQLite
+ * asks that the transaction be rolled back instead, as the other connection
+ * may be waiting on this one.
+ */
+struct sqlite_retry_policy
+{
+    /// The most retries made after the first attempt. Zero disables retries.
+    std::size_t max_retries = 0;
+    std::chrono::steady_clock::duration initial_delay
+        = std::chrono::milliseconds{1};
+    std::chrono::steady_clock::duration max_delay
+        = std::chrono::milliseconds{100};
+    double multiplier = 2.0;
+    bool jitter = true;
+};
+
+/** Options for a single asynchronous operation on a SQLite connection.
+ *
+ * Can be implicitly created from a ``sqlite_retry_policy``.
+ */
+struct sqlite_op_options
+{
+    sqlite_op_options() = default;
+    sqlite_op_options(const sqlite_retry_policy& r)
+        : retry(r)
+    {
+    }
+
+    /// How to retry when the database is busy. If not set, the connection's
+    /// retry policy is used.
+    boost::optional<sqlite_retry_policy> retry;
+    /** When to give up on the operation.
+     *
+     * An operation which has not started by its deadline completes with
+     * ``sqlite_errc::interrupt`` without running. A statement still running
+     * at its deadline is interrupted, and also completes with
+     * ``sqlite_errc::interrupt``.
+     */
+    boost::optional<std::chrono::steady_clock::time_point> deadline;
+
+    /// Set the deadline to ``timeout`` from now
+    sqlite_op_options& timeout(std::chrono::steady_clock::duration timeout)
+    {
+        deadline = std::chrono::steady_clock::now() + timeout;
+        return *this;
+    }
+};
+
+/// Options for ``sqlite::set_group_commit``
+struct sqlite_group_commit_options
+{
+    /// How long a shared transaction stays open for more writes after the
+    /// first write joins it
+    std::chrono::steady_clock::duration window = std::chrono::milliseconds{2};
+    /// The most writes in one shared transaction. The transaction is
+    /// committed as soon as this many writes have joined it.
+    std::size_t max_writes = 128;
+};
+
+/// Options for ``sqlite::backup`` and ``sqlite::async_backup``
+struct sqlite_backup_options
+{
+    /// The number of pages copied in each step. A negative number copies
+    /// the whole database in one step.
+    int pages_per_step = 256;
+    /// How long an asynchronous backup waits between steps
+    std::chrono::steady_clock::duration step_delay{0};
+    /// How long to wait before retrying a step that found the source
+    /// database busy
+    std::chrono::steady_clock::duration busy_delay
+        = std::chrono::milliseconds{10};
+    /// How many times in a row a step may find a database busy before the
+    /// backup gives up with ``sqlite_errc::busy``
+    std::size_t max_busy_retries = 500;
+};
+
+/// The progress of a backup, reported after each step
+struct sqlite_backup_progress
+{
+    /// Pages left to copy
+    std::size_t remaining;
+    /// Pages in the source database
+    std::size_t total;
+};
+
 class sqlite;
 
+/// The kinds of task counted separately in ``sqlite_service_metrics``
+enum class sqlite_op_kind
+{
+    open,
+    prepare,
+    /// Executing statements, and beginning and ending transactions
+    execute,
+    /// Stepping through the results of statements
+    step,
+    /// Backups, BLOB I/O and other work
+    other,
+};
+
+/// The number of ``sqlite_op_kind`` values
+constexpr std::size_t sqlite_op_kind_count = 5;
+
+/// Timings of one kind of task on the ``sqlite_service`` thread pool
+struct sqlite_op_metrics
+{
+    /// From queueing the task to a worker thread starting it. This includes
+    /// waiting behind earlier tasks on the same connection.
+    histogram_snapshot queue_wait;
+    /// From a worker thread starting the task to finishing it, which is the
+    /// time spent in SQLite
+    histogram_snapshot run_time;
+    /// From queueing the task to finishing it
+    histogram_snapshot latency;
+};
+
+/// A snapshot of the metrics of a ``sqlite_service``
+struct sqlite_service_metrics
+{
+    /// Indexed by ``sqlite_op_kind``
+    std::array<sqlite_op_metrics, sqlite_op_kind_count> ops;
+    /// The number of tasks queued but not yet started
+    std::size_t queue_depth = 0;
+    /// The number of worker threads running a task
+    std::size_t busy_workers = 0;
+    /// The number of worker threads
+    std::size_t threads = 0;
+
+    const sqlite_op_metrics& operator[](sqlite_op_kind kind) const
+    {
+        return ops[static_cast<std::size_t>(kind)];
+    }
+
+    /** Format the metrics in the Prometheus text exposition format.
+     *
+     * The gauges are written as ``<prefix>_queue_depth``,
+     * ``<prefix>_busy_workers`` and ``<prefix>_threads``. Each of the timings
+     * is written as a summary in seconds, such as
+     * ``<prefix>_queue_wait_seconds``, labelled with the kind of operation
+     * (``op="execute"``), with its 50th, 90th, 99th and 99.9th percentiles.
+     */
+    string to_prometheus(const string& prefix = "adio_sqlite") const;
+};
+
+/// A statement run recorded by the trace of a connection
+struct sqlite_trace_event
+{
+    /// The SQL of the statement. Bound parameters are expanded into it if
+    /// ``sqlite_trace_options::expand_sql`` is set and SQLite supports it.
+    string sql;
+    /// How long the statement took to run, as measured by SQLite
+    std::chrono::nanoseconds duration{0};
+    /// The connection the statement ran on
+    const sqlite* connection = nullptr;
+    /// When the statement finished running
+    std::chrono::system_clock::time_point finished;
+};
+
+/** Receives the statements recorded by ``sqlite::set_trace``.
+ *
+ * ``record()`` is called on the thread that ran the statement, which is a
+ * ``sqlite_service`` thread for asynchronous operations. A sink may be shared
+ * by several connections, so it must be safe to call from several threads at
+ * once.
+ */
+class sqlite_trace_sink
+{
+public:
+    virtual ~sqlite_trace_sink() = default;
+    virtual void record(const sqlite_trace_event& event) = 0;
+};
+
+/// Options for ``sqlite::set_trace``
+struct sqlite_trace_options
+{
+    /// Where the recorded statements go
+    std::shared_ptr<sqlite_trace_sink> sink;
+    /// Statements which run for less time than this are not recorded. The
+    /// SQL of these statements is never expanded or copied.
+    std::chrono::nanoseconds threshold{0};
+    /// Expand bound parameters into the recorded SQL
+    bool expand_sql = true;
+};
+
+/// How a top-level transaction acquires its locks. See the SQLite
+/// documentation of ``BEGIN`` for details.
+enum class sqlite_transaction_mode
+{
+    /// Take locks on the first read or write
+    deferred,
+    /// Take the write lock right away
+    immediate,
+    /// Take the write lock right away, and keep out readers as well (outside
+    /// of WAL mode)
+    exclusive,
+};
+
+/** A transaction, or a savepoint nested in one, on a SQLite connection.
+ *
+ * Created by ``sqlite::begin`` or ``sqlite::async_begin``. Rolls back when
+ * destroyed unless it has been committed or rolled back. The SQL to begin
+ * and end transactions is compiled once per connection, so starting a
+ * transaction doesn't parse any SQL.
+ *
+ * Nested transactions must be finished before the transactions they are
+ * nested in.
+ */
+class sqlite_transaction
+{
+    friend class sqlite;
+
+    std::shared_ptr<sqlite> _con;
+    // Zero for a top-level transaction, or the depth of its savepoint
+    std::size_t _savepoint = 0;
+    bool _active = false;
+
+    sqlite_transaction(std::shared_ptr<sqlite> con, std::size_t savepoint)
+        : _con{std::move(con)}
+        , _savepoint{savepoint}
+        , _active{true}
+    {
+    }
+
+    void _end(bool commit, error_code& ec);
+    void _async_end(bool commit, std::function<void(error_code)> handler);
+
+public:
+    using commit_handler_signature = void(error_code);
+    using rollback_handler_signature = void(error_code);
+
+    sqlite_transaction() = default;
+    sqlite_transaction(sqlite_transaction&& other)
+        : _con{std::move(other._con)}
+        , _savepoint{other._savepoint}
+        , _active{other._active}
+    {
+        other._active = false;
+    }
+    sqlite_transaction& operator=(sqlite_transaction&& other);
+    ~sqlite_transaction();
+
+    /// Whether the transaction is still open
+    bool active() const { return _active; }
+    /// Whether this is a savepoint inside another transaction
+    bool nested() const { return _savepoint != 0; }
+
+    /** Commit the transaction, or release the savepoint.
+     *
+     * If the commit fails (eg. with ``sqlite_errc::busy``), the transaction
+     * is still open and the commit may be attempted again.
+     */
+    void commit(error_code& ec) { _end(true, ec); }
+    void commit()
+    {
+        error_code ec;
+        commit(ec);
+        detail::throw_if_error(ec, "Failed to commit transaction");
+    }
+    void rollback(error_code& ec) { _end(false, ec); }
+    void rollback()
+    {
+        error_code ec;
+        rollback(ec);
+        detail::throw_if_error(ec, "Failed to roll back transaction");
+    }
+
+    /** Asynchronously commit the transaction on the connection's lane.
+     *
+     * The transaction is no longer active once this is called. If the
+     * commit fails, the transaction is rolled back.
+     */
+    template <typename Handler> void async_commit(Handler&& handler)
+    {
+        _async_end(true, std::forward<Handler>(handler));
+    }
+    template <typename Handler> void async_rollback(Handler&& handler)
+    {
+        _async_end(false, std::forward<Handler>(handler));
+    }
+};
+
+/** The SQLite database driver.
+ *
+ * Asynchronous operations are run on a thread pool owned by the
+ * ``sqlite_service``. Each connection has its own serial lane (an Asio strand)
+ * on that pool: operations started on the same connection run in the order
+ * they were started and never overlap, while operations on different
+ * connections run in parallel. As with Asio sockets, a single connection (and
+ * its statements) must not be used from several threads at once.
+ *
+ * Statements are still reset, finalized or returned to the statement cache
+ * on whichever thread drops the last reference to them, such as the thread
+ * running a completion handler, while the lane may be stepping another
+ * statement. Connections are therefore opened in SQLite's serialized
+ * threading mode (``SQLITE_OPEN_FULLMUTEX``), which guards each call with the
+ * connection's mutex. Only pass ``SQLITE_OPEN_NOMUTEX`` if every statement of
+ * the connection is dropped on the thread that is using it.
+ */
 class sqlite : public std::enable_shared_from_this<sqlite>
 {
+    friend class sqlite_transaction;
+    friend class sqlite_blob;
+
 public:
     using statement = detail::sqlite_statement;
     using row = statement::row;
@@ -210,14 +1133,70 @@ private:
     std::reference_wrapper<io_service> _parent_ios;
     std::reference_wrapper<service> _service;
     std::unique_ptr<detail::sqlite_private> _private;
+    sqlite_retry_policy _retry_policy;
+    boost::optional<sqlite_group_commit_options> _group_commit;
+
+    /// Queue a task on this connection's lane of the service's thread pool.
+    /// Tasks pushed to the same connection run one at a time, in the order
+    /// they were pushed. ``kind`` is the metric the task is counted under.
+    template <typename Task> void _push_task(sqlite_op_kind kind, Task&& task);
+    /// Post a completion handler to the ``io_service`` the connection was
+    /// created on
+    template <typename Fn> void _post_handler(Fn&& fn);
+    void _start_task(std::function<void()>,
+                     sqlite_op_kind kind = sqlite_op_kind::other);
 
-    template <typename Task> void _push_task(Task&& task);
+    /// Run ``attempt`` on this connection's lane, then call ``done`` there
+    /// with its result. Attempts that fail because the database is busy are
+    /// run again later. Operations that are cancelled or pass their deadline
+    /// before they start complete without running ``attempt``.
+    void _push_op(sqlite_op_kind kind,
+                  const sqlite_op_options& opts,
+                  std::function<error_code()> attempt,
+                  std::function<void(error_code)> done);
+
+    /// Like _push_op, but a write joins the shared group commit transaction
+    /// and ``done`` is called once that transaction has been committed.
+    void _push_grouped(const sqlite_op_options& opts,
+                       statement& st,
+                       std::function<void(error_code)> done);
+    /// Commit the shared transaction and complete its writes. Runs on the
+    /// connection's lane.
+    void _commit_group();
+    /// Set ``ec`` and return true if a group commit transaction is open and
+    /// this is not the connection's lane, where synchronous calls would race
+    /// the group's commit
+    bool _refuse_in_group(error_code& ec) const;
 
     std::shared_ptr<detail::sqlite_statement_private>
     _prepare(const string&, error_code&) const;
 
     std::vector<statement> _multi_prepare(const string&, error_code&) const;
 
+    /// Back up this database to ``dest``, or to a new database opened at
+    /// ``dest_path`` if ``dest`` is null
+    void _start_backup(::sqlite3* dest,
+                       const string& dest_path,
+                       const sqlite_backup_options& opts,
+                       std::function<void(sqlite_backup_progress)> progress,
+                       std::function<void(error_code)> done);
+    void _backup(::sqlite3* dest,
+                 const string& dest_path,
+                 const sqlite_backup_options& opts,
+                 error_code& ec);
+
+    /// End a transaction or savepoint begun by begin()
+    void _end_transaction(std::size_t savepoint, bool commit, error_code&);
+
+    // Transaction wrapping for batches. A batch started while a transaction
+    // is already open runs in that transaction and does not commit it. A
+    // failed commit rolls back.
+    bool _batch_begin(error_code&);
+    void _batch_end(bool commit, error_code&);
+    /// The error for the exception being handled, which was thrown while
+    /// binding a batch. Must be called from a ``catch`` block.
+    static error_code _batch_exception_error();
+
 public:
     sqlite(service& service);
     sqlite(sqlite&&);
@@ -226,23 +1205,195 @@ public:
 
     void close();
 
+    using native_handle_type = ::sqlite3*;
+    /// Get the underlying SQLite database handle, or ``nullptr`` if the
+    /// connection is not open
+    native_handle_type native_handle() const;
+
+    /// The default number of idle statements each connection keeps compiled
+    static constexpr std::size_t default_statement_cache_capacity = 64;
+
+    /** Set the capacity of this connection's prepared statement cache.
+     *
+     * Statements created by ``prepare()`` (and by ``execute()`` with a query
+     * string) are returned to a per-connection LRU cache when they are
+     * destroyed. Preparing the same SQL again reuses the compiled statement
+     * after resetting it and clearing its bindings. A capacity of zero
+     * disables the cache.
+     */
+    void set_statement_cache_capacity(std::size_t capacity);
+    /// Get the hit/miss counters of the prepared statement cache
+    sqlite_statement_cache_stats statement_cache_stats() const;
+
+    /** Enable or disable per-connection statement statistics.
+     *
+     * While enabled, the ``stats()`` of each statement are added to a total
+     * for its SQL text when the statement is destroyed or returned to the
+     * statement cache, and the time spent stepping statements is measured.
+     * Disabling statistics discards the totals.
+     */
+    void set_statement_stats_enabled(bool enabled);
+    /// Get the statement statistics totals, sorted by SQL text
+    std::vector<std::pair<string, sqlite_statement_stats>>
+    statement_stats() const;
+
+    using transaction = sqlite_transaction;
+    using begin_handler_signature = void(transaction, error_code);
+    /** Begin a transaction.
+     *
+     * If a transaction is already open on the connection, a savepoint is
+     * created inside it instead, and ``mode`` is ignored.
+     */
+    transaction begin(sqlite_transaction_mode mode, error_code& ec);
+    transaction begin(error_code& ec)
+    {
+        return begin(sqlite_transaction_mode::deferred, ec);
+    }
+    transaction
+    begin(sqlite_transaction_mode mode = sqlite_transaction_mode::deferred)
+    {
+        error_code ec;
+        auto tr = begin(mode, ec);
+        detail::throw_if_error(ec, "Failed to begin transaction");
+        return tr;
+    }
+    template <typename Handler>
+    void async_begin(sqlite_transaction_mode mode, Handler&& handler)
+    {
+        // Shared so that the task stays copyable
+        auto tr = std::make_shared<transaction>();
+        _push_op(
+            sqlite_op_kind::execute,
+            sqlite_op_options{},
+            [this, mode, tr] {
+                error_code ec;
+                *tr = begin(mode, ec);
+                return ec;
+            },
+            [
+                this_pin = shared_from_this(),
+                work_pin = detail::make_work(_parent_ios),
+                this,
+                tr,
+                handler = std::forward<Handler>(handler)
+            ](error_code ec) {
+                _post_handler([handler, tr, ec]() mutable {
+                    handler(std::move(*tr), ec);
+                });
+            });
+    }
+    template <typename Handler> void async_begin(Handler&& handler)
+    {
+        async_begin(sqlite_transaction_mode::deferred,
+                    std::forward<Handler>(handler));
+    }
+
+    /** Set how this connection's asynchronous operations retry when the
+     * database is busy. Individual operations may be given their own policy.
+     *
+     * Retried operations give up their place on the connection's lane while
+     * they wait, so operations started later on the same connection may run
+     * before them.
+     */
+    void set_retry_policy(const sqlite_retry_policy& retry)
+    {
+        _retry_policy = retry;
+    }
+    const sqlite_retry_policy& retry_policy() const { return _retry_policy; }
+
+    /** Coalesce asynchronous writes into shared transactions.
+     *
+     * With group commit enabled, ``async_execute`` of a statement that writes
+     * to the database, while no transaction is open on the connection, opens
+     * a shared transaction (with ``BEGIN IMMEDIATE``) instead of committing
+     * on its own. Writes started within ``opts.window`` of the first one join
+     * that transaction, up to ``opts.max_writes``, and then all of them are
+     * committed together with a single sync to disk.
+     *
+     * Each write runs inside its own savepoint. A write that fails is rolled
+     * back to its savepoint and completes with its error right away, without
+     * affecting the others. The handlers of successful writes are called
+     * after the shared commit, with its result.
+     *
+     * Other asynchronous operations on the connection, including reads, run
+     * inside the shared transaction while it is open. Synchronous operations
+     * that run statements fail with ``operation_in_progress`` while a group
+     * is open, as they would race its commit; use the asynchronous versions
+     * instead. Pass ``boost::none`` to disable group commit.
+     */
+    void set_group_commit(
+        const boost::optional<sqlite_group_commit_options>& opts)
+    {
+        _group_commit = opts;
+    }
+
+    /** Record the statements run on this connection, and how long they took.
+     *
+     * Every statement that runs for at least ``opts.threshold`` is passed to
+     * ``opts.sink`` when it finishes, so a threshold turns the trace into a
+     * slow query log. Timing comes from SQLite's own profiling hook, which is
+     * only installed while tracing is enabled. Pass ``boost::none`` to stop
+     * tracing. See ``adio/sqlite_trace.hpp`` for some ready-made sinks.
+     *
+     * The trace stays in effect if the connection is closed and reopened.
+     * Like opening and closing, this must not be called while operations are
+     * running on the connection.
+     */
+    void set_trace(const boost::optional<sqlite_trace_options>& opts);
+
+    /** Cancel the asynchronous operations started on this connection so far.
+     *
+     * Operations that have not started running complete with
+     * ``sqlite_errc::interrupt`` without touching the database, and so do
+     * operations waiting to retry. A running statement is interrupted at its
+     * next progress check, which SQLite makes every thousand virtual
+     * machine instructions. If it was writing inside an explicit transaction,
+     * SQLite rolls that transaction back.
+     *
+     * Opening, preparing and synchronous operations are not cancelled. This
+     * may be called from any thread.
+     *
+     * Cancellation and deadlines rely on a progress handler, which every
+     * connection installs when it is opened. SQLite calls it every thousand
+     * virtual machine instructions of every statement, synchronous ones
+     * included. When no asynchronous operation is running, it costs an
+     * indirect call and an atomic load. While one is running, it also reads
+     * the clock if the operation has a deadline.
+     */
+    void cancel();
+
     using open_handler_signature = void(error_code);
-    error_code open(const string&);
+    error_code open(const string& path)
+    {
+        return open(path, sqlite_open_options{});
+    }
+    /// Open the database at ``path``, then apply ``opts``
+    error_code open(const string& path, const sqlite_open_options& opts);
     template <typename Handler>
-    void async_open(const string& path, Handler&& handler)
+    void async_open(const string& path,
+                    const sqlite_open_options& opts,
+                    Handler&& handler)
     {
         auto this_pin = shared_from_this();
-        _push_task([
+        _push_task(sqlite_op_kind::open, [
             this_pin,
             work_pin = detail::make_work(_parent_ios),
             this,
             path,
+            opts,
             handler = std::forward<Handler>(handler)
         ] {
-            auto ec = open(path);
-            _parent_ios.get().post(std::bind(handler, ec));
+            auto ec = open(path, opts);
+            _post_handler(std::bind(handler, ec));
         });
     }
+    template <typename Handler>
+    void async_open(const string& path, Handler&& handler)
+    {
+        async_open(path,
+                   sqlite_open_options{},
+                   std::forward<Handler>(handler));
+    }
 
     using prepare_handler_signature = void(statement, error_code);
     statement prepare(const string& str)
@@ -278,7 +1429,7 @@ public:
     template <typename Handler>
     void async_prepare(const string& query, Handler&& handler)
     {
-        _push_task([
+        _push_task(sqlite_op_kind::prepare, [
             this_pin = shared_from_this(),
             work_pin = detail::make_work(_parent_ios),
             this,
@@ -287,7 +1438,7 @@ public:
         ] {
             error_code err;
             auto st = _prepare(query, err);
-            _parent_ios.get().post([st, err, handler]() mutable {
+            _post_handler([st, err, handler]() mutable {
                 handler(statement{std::move(st)}, err);
             });
         });
@@ -302,21 +1453,46 @@ public:
         detail::throw_if_error(ec, "Failed to execute prepared statement");
     }
     void execute(statement&& st, error_code& ec) { execute(st, ec); }
-    void execute(statement& st, error_code& ec) { st.execute(ec); }
+    void execute(statement& st, error_code& ec)
+    {
+        ec = {};
+        if (_refuse_in_group(ec)) return;
+        st.execute(ec);
+    }
     template <typename Handler>
-    void async_execute(statement& st, Handler&& handler)
+    void async_execute(statement& st,
+                       const sqlite_op_options& opts,
+                       Handler&& handler)
     {
-        _push_task([
+        std::function<void(error_code)> done = [
             this_pin = shared_from_this(),
             work_pin = detail::make_work(_parent_ios),
             this,
-            st_ref = std::ref(st),
             handler = std::forward<Handler>(handler)
-        ]() mutable {
-            error_code ec;
-            execute(st_ref, ec);
-            _parent_ios.get().post(std::bind(handler, ec));
-        });
+        ](error_code ec)
+        {
+            _post_handler(std::bind(handler, ec));
+        };
+        if (_group_commit)
+        {
+            _push_grouped(opts, st, std::move(done));
+            return;
+        }
+        _push_op(sqlite_op_kind::execute,
+                 opts,
+                 [this, st_ref = std::ref(st)] {
+                     error_code ec;
+                     execute(st_ref.get(), ec);
+                     return ec;
+                 },
+                 std::move(done));
+    }
+    template <typename Handler>
+    void async_execute(statement& st, Handler&& handler)
+    {
+        async_execute(st,
+                      sqlite_op_options{},
+                      std::forward<Handler>(handler));
     }
 
     void execute(const string& query)
@@ -343,17 +1519,13 @@ public:
         ](statement st, error_code ec) {
             if (ec)
             {
-                _parent_ios.get().post(std::bind(handler, ec));
+                handler(ec);
                 return;
             }
-            async_execute([
-                this_pin,
-                work_pin,
-                this,
-                handler = std::forward<Handler>(handler)
-            ](error_code ec) {
-                _parent_ios.get().post(std::bind(handler, ec));
-            });
+            // Keep the statement alive until it has executed
+            auto st_ptr = std::make_shared<statement>(std::move(st));
+            async_execute(*st_ptr,
+                          [st_ptr, handler](error_code ec) { handler(ec); });
         });
     }
 
@@ -368,29 +1540,365 @@ public:
     row step(statement& st, error_code& ec)
     {
         ec = {};
+        if (_refuse_in_group(ec)) return row({});
         st.execute(ec);
         if (ec || st.done()) return row({});
         return st.current_row();
     }
+    template <typename Handler>
+    void async_step(statement& st, const sqlite_op_options& opts, Handler&& h)
+    {
+        auto r = std::make_shared<row>(std::vector<value>{});
+        _push_op(
+            sqlite_op_kind::step,
+            opts,
+            [this, st_ref = std::ref(st), r] {
+                error_code ec;
+                *r = step(st_ref, ec);
+                return ec;
+            },
+            [
+                this_pin = shared_from_this(),
+                work_pin = detail::make_work(_parent_ios),
+                this,
+                r,
+                handler = std::forward<Handler>(h)
+            ](error_code ec) {
+                _post_handler([handler, r, ec]() mutable {
+                    handler(std::move(*r), ec);
+                });
+            });
+    }
     template <typename Handler> void async_step(statement& st, Handler&& h)
     {
-        _push_task([
+        async_step(st, sqlite_op_options{}, std::forward<Handler>(h));
+    }
+
+    /** Step through up to ``max_rows`` rows of a statement at once.
+     *
+     * Returns fewer than ``max_rows`` rows only when the end of the results
+     * is reached, after which ``st.done()`` is ``true``.
+     */
+    std::vector<row> step_batch(statement& st, std::size_t max_rows)
+    {
+        error_code ec;
+        auto rows = step_batch(st, max_rows, ec);
+        detail::throw_if_error(ec, "Failed to step query");
+        return rows;
+    }
+    std::vector<row>
+    step_batch(statement& st, std::size_t max_rows, error_code& ec)
+    {
+        ec = {};
+        std::vector<row> rows;
+        if (_refuse_in_group(ec)) return rows;
+        rows.reserve(max_rows);
+        while (rows.size() < max_rows)
+        {
+            st.execute(ec);
+            if (ec || st.done()) break;
+            rows.push_back(st.current_row());
+        }
+        return rows;
+    }
+
+    using step_batch_handler_signature = void(std::vector<row>, error_code);
+    /** Asynchronously step through up to ``max_rows`` rows.
+     *
+     * The rows are collected on the worker thread and delivered to the
+     * handler together, so scanning a result costs one handler dispatch per
+     * batch rather than per row.
+     */
+    template <typename Handler>
+    void async_step_batch(statement& st,
+                          std::size_t max_rows,
+                          const sqlite_op_options& opts,
+                          Handler&& h)
+    {
+        auto rows = std::make_shared<std::vector<row>>();
+        _push_op(
+            sqlite_op_kind::step,
+            opts,
+            [this, st_ref = std::ref(st), max_rows, rows] {
+                // Rows collected before a busy error are kept across retries
+                error_code ec;
+                auto more = step_batch(st_ref, max_rows - rows->size(), ec);
+                std::move(more.begin(), more.end(), std::back_inserter(*rows));
+                return ec;
+            },
+            [
+                this_pin = shared_from_this(),
+                work_pin = detail::make_work(_parent_ios),
+                this,
+                rows,
+                handler = std::forward<Handler>(h)
+            ](error_code ec) {
+                _post_handler([handler, rows, ec]() mutable {
+                    handler(std::move(*rows), ec);
+                });
+            });
+    }
+    template <typename Handler>
+    void async_step_batch(statement& st, std::size_t max_rows, Handler&& h)
+    {
+        async_step_batch(st,
+                         max_rows,
+                         sqlite_op_options{},
+                         std::forward<Handler>(h));
+    }
+
+    /** Execute a statement once for every row in a range.
+     *
+     * @param st A statement with one parameter per column of the rows
+     * @param rows A range of ``adio::row`` or ``std::tuple`` objects. Each is
+     * bound to ``st`` by position and then executed.
+     * @param opts Batch options
+     * @param ec Set to the first error encountered
+     *
+     * Unless a transaction is already open on the connection, the rows are
+     * written inside transactions of ``opts.chunk_size`` rows each. On error,
+     * the current chunk is rolled back, while chunks already committed stay
+     * committed.
+     */
+    template <typename RowRange>
+    void execute_batch(statement& st,
+                       const RowRange& rows,
+                       const sqlite_batch_options& opts,
+                       error_code& ec)
+    {
+        ec = {};
+        if (_refuse_in_group(ec)) return;
+        const auto owned = _batch_begin(ec);
+        if (ec) return;
+        std::size_t in_chunk = 0;
+        try
+        {
+            for (const auto& r : rows)
+            {
+                st.reset();
+                detail::bind_batch_row(st, r);
+                st.execute(ec);
+                if (ec) break;
+                if (owned && ++in_chunk == opts.chunk_size)
+                {
+                    _batch_end(true, ec);
+                    if (ec) return;
+                    _batch_begin(ec);
+                    if (ec) return;
+                    in_chunk = 0;
+                }
+            }
+        }
+        catch (...)
+        {
+            st.reset();
+            error_code ignore;
+            if (owned) _batch_end(false, ignore);
+            throw;
+        }
+        st.reset();
+        if (!owned) return;
+        if (ec)
+        {
+            error_code ignore;
+            _batch_end(false, ignore);
+            return;
+        }
+        _batch_end(true, ec);
+    }
+    template <typename RowRange>
+    void execute_batch(statement& st, const RowRange& rows, error_code& ec)
+    {
+        execute_batch(st, rows, sqlite_batch_options{}, ec);
+    }
+    template <typename RowRange>
+    void execute_batch(statement& st,
+                       const RowRange& rows,
+                       const sqlite_batch_options& opts = {})
+    {
+        error_code ec;
+        execute_batch(st, rows, opts, ec);
+        detail::throw_if_error(ec, "Failed to execute batch");
+    }
+
+    using execute_batch_handler_signature = void(error_code);
+    /// Asynchronously execute a batch. The whole batch runs as a single task
+    /// on the connection's lane. ``rows`` is copied (or moved) into the task.
+    /// Batches are not retried by the connection's retry policy, as part of
+    /// the batch may already be committed when the database becomes busy.
+    /// A row that can't be bound (eg. with more values than the statement
+    /// has parameters) fails the batch with ``sqlite_errc::range``, rather
+    /// than throwing on the worker thread.
+    template <typename RowRange, typename Handler>
+    void async_execute_batch(statement& st,
+                             RowRange&& rows,
+                             const sqlite_batch_options& opts,
+                             Handler&& handler)
+    {
+        using range_type = typename std::decay<RowRange>::type;
+        auto rows_ptr
+            = std::make_shared<range_type>(std::forward<RowRange>(rows));
+        _push_op(
+            sqlite_op_kind::execute,
+            sqlite_op_options{sqlite_retry_policy{}},
+            [this, st_ref = std::ref(st), rows_ptr, opts] {
+                error_code ec;
+                try
+                {
+                    execute_batch(st_ref.get(), *rows_ptr, opts, ec);
+                }
+                catch (...)
+                {
+                    // The chunk has already been rolled back
+                    ec = _batch_exception_error();
+                }
+                return ec;
+            },
+            [
+                this_pin = shared_from_this(),
+                work_pin = detail::make_work(_parent_ios),
+                this,
+                handler = std::forward<Handler>(handler)
+            ](error_code ec) {
+                _post_handler(std::bind(handler, ec));
+            });
+    }
+    template <typename RowRange, typename Handler>
+    void
+    async_execute_batch(statement& st, RowRange&& rows, Handler&& handler)
+    {
+        async_execute_batch(st,
+                            std::forward<RowRange>(rows),
+                            sqlite_batch_options{},
+                            std::forward<Handler>(handler));
+    }
+
+    /** Copy this database to another, while it is in use.
+     *
+     * @param dest_path The file to write the backup to. It is created if
+     * necessary, and its contents are replaced.
+     * @param opts Options for the backup
+     * @param ec Set to the first error encountered
+     *
+     * The database is copied ``opts.pages_per_step`` pages at a time. If it is
+     * written to through another connection during the backup, the backup
+     * starts over. Writes through this connection are copied as they are made.
+     */
+    void backup(const string& dest_path,
+                const sqlite_backup_options& opts,
+                error_code& ec)
+    {
+        _backup(nullptr, dest_path, opts, ec);
+    }
+    void backup(const string& dest_path,
+                const sqlite_backup_options& opts = {})
+    {
+        error_code ec;
+        backup(dest_path, opts, ec);
+        detail::throw_if_error(ec, "Failed to back up database");
+    }
+    /// Back up to an open connection. Nothing else may use ``dest`` until the
+    /// backup completes.
+    void
+    backup(sqlite& dest, const sqlite_backup_options& opts, error_code& ec)
+    {
+        _backup(dest.native_handle(), {}, opts, ec);
+    }
+    void backup(sqlite& dest, const sqlite_backup_options& opts = {})
+    {
+        error_code ec;
+        backup(dest, opts, ec);
+        detail::throw_if_error(ec, "Failed to back up database");
+    }
+
+    using backup_handler_signature = void(error_code);
+    /** Asynchronously copy this database to another.
+     *
+     * Each step of the backup runs as its own task on the connection's lane,
+     * so other operations on this connection run between steps, rather than
+     * waiting for the whole backup. After each step, ``progress`` is invoked
+     * through the ``io_service`` with a ``sqlite_backup_progress``.
+     *
+     * The backup is stopped, completing with ``sqlite_errc::interrupt``, if
+     * the connection's operations are cancelled.
+     */
+    template <typename Progress, typename Handler>
+    void async_backup(const string& dest_path,
+                      const sqlite_backup_options& opts,
+                      Progress&& progress,
+                      Handler&& handler)
+    {
+        _start_backup(nullptr,
+                      dest_path,
+                      opts,
+                      _backup_progress(std::forward<Progress>(progress)),
+                      _backup_done(std::forward<Handler>(handler)));
+    }
+    /// Back up to an open connection. Nothing else may use ``dest`` until the
+    /// backup completes.
+    template <typename Progress, typename Handler>
+    void async_backup(sqlite& dest,
+                      const sqlite_backup_options& opts,
+                      Progress&& progress,
+                      Handler&& handler)
+    {
+        // Keep the destination open for the length of the backup
+        _start_backup(dest.native_handle(),
+                      {},
+                      opts,
+                      _backup_progress(std::forward<Progress>(progress)),
+                      [
+                          dest_pin = dest.shared_from_this(),
+                          done = _backup_done(std::forward<Handler>(handler))
+                      ](error_code ec) { done(ec); });
+    }
+
+private:
+    template <typename Progress>
+    std::function<void(sqlite_backup_progress)>
+    _backup_progress(Progress&& progress)
+    {
+        return [
             this_pin = shared_from_this(),
             work_pin = detail::make_work(_parent_ios),
             this,
-            st_ref = std::ref(st),
-            handler = std::forward<Handler>(h)
-        ]() mutable {
-            error_code ec;
-            step(st_ref, ec);
-            _parent_ios.get().post(std::bind(handler, ec));
-        });
+            progress = std::forward<Progress>(progress)
+        ](sqlite_backup_progress p)
+        {
+            _post_handler(std::bind(progress, p));
+        };
+    }
+    template <typename Handler>
+    std::function<void(error_code)> _backup_done(Handler&& handler)
+    {
+        return [
+            this_pin = shared_from_this(),
+            work_pin = detail::make_work(_parent_ios),
+            this,
+            handler = std::forward<Handler>(handler)
+        ](error_code ec)
+        {
+            _post_handler(std::bind(handler, ec));
+        };
     }
 };
 
 namespace detail
 {
 
+/// The spans of a completion handler posted by a task traced on a
+/// ``timeline``
+struct sqlite_handler_trace
+{
+    std::shared_ptr<timeline> tl;
+    std::uint64_t id;
+    sqlite_op_kind kind;
+    timeline::clock::time_point posted;
+
+    /// Record the handler's time in the queue, and its run up to now
+    void ran(timeline::clock::time_point started) const;
+};
+
 class sqlite_service : public db_service_base<sqlite_service, sqlite>
 {
 public:
@@ -405,27 +1913,94 @@ private:
     std::once_flag _start_threads_flag;
     std::vector<std::thread> _threads;
 
-    void _ensure_threads_started();
-    void _start_task(std::function<void()>);
+    struct op_histograms
+    {
+        latency_histogram queue_wait;
+        latency_histogram run_time;
+        latency_histogram latency;
+    };
+    std::atomic<bool> _metrics_enabled{false};
+    std::atomic<std::size_t> _thread_count{0};
+    std::atomic<std::size_t> _queued{0};
+    std::atomic<std::size_t> _busy{0};
+    std::array<op_histograms, sqlite_op_kind_count> _op_metrics;
+    std::atomic<bool> _tracing{false};
+    mutable std::mutex _timeline_mutex;
+    std::shared_ptr<timeline> _timeline;
 
-    template <typename Task> void _push_task(Task&& task)
+    void _ensure_threads_started();
+    /// Post a task to a connection's lane
+    void _post(io_service::strand& lane,
+               std::function<void()> task,
+               sqlite_op_kind kind);
+    /// Get the trace of a handler posted by the task running on the calling
+    /// thread, if that task is being traced
+    std::shared_ptr<sqlite_handler_trace> _trace_handler() const
     {
-        std::function<void()> pt{std::forward<Task>(task)};
-        _start_task(std::move(pt));
+        if (!_tracing.load(std::memory_order_relaxed)) return nullptr;
+        return _current_handler_trace();
     }
+    static std::shared_ptr<sqlite_handler_trace> _current_handler_trace();
 
 public:
     sqlite_service(io_service&);
     ~sqlite_service();
 
+    /** Enable or disable the collection of metrics.
+     *
+     * While enabled, each task queued on the thread pool by the asynchronous
+     * operations of connections using this service records how long it
+     * waited in the queue and how long it ran. Disabled by default. The
+     * service of an ``io_service`` can be found with
+     * ``asio::use_service<adio::sqlite::service>(ios)``.
+     */
+    void set_metrics_enabled(bool enabled) { _metrics_enabled = enabled; }
+    bool metrics_enabled() const { return _metrics_enabled; }
+    /// Get a snapshot of the metrics
+    sqlite_service_metrics metrics() const;
+    /// Discard the recorded timings. The gauges are unaffected.
+    void reset_metrics();
+
+    /** Record the asynchronous operations of connections using this service
+     * on a timeline, or stop recording them if ``tl`` is null.
+     *
+     * Each operation gets a correlation ID, and its spans are recorded as
+     * ``<kind>: call`` on the calling thread, ``<kind>: queued`` until a worker
+     * thread picks it up, ``<kind>: run`` on the worker thread,
+     * ``<kind>: handler queued`` until its completion handler is invoked, and
+     * ``<kind>: handler`` on the thread running the handler. ``<kind>`` is a
+     * ``sqlite_op_kind``, such as ``execute``.
+     *
+     * Retried attempts and the shared commit of a group are not recorded.
+     */
+    void set_timeline(std::shared_ptr<timeline> tl);
+
     using connection_type = sqlite;
 };
 
 } /* detail */
 
-template <typename Task> void sqlite::_push_task(Task&& task)
+template <typename Task>
+void sqlite::_push_task(sqlite_op_kind kind, Task&& task)
+{
+    std::function<void()> pt{std::forward<Task>(task)};
+    _start_task(std::move(pt), kind);
+}
+
+template <typename Fn> void sqlite::_post_handler(Fn&& fn)
 {
-    _service.get()._push_task(std::forward<Task>(task));
+    auto& ios = _parent_ios.get();
+    auto trace = _service.get()._trace_handler();
+    if (!trace)
+    {
+        ios.post(std::forward<Fn>(fn));
+        return;
+    }
+    ios.post([ trace, fn = std::forward<Fn>(fn) ]() mutable {
+        const auto started = timeline::clock::now();
+        fn();
+        trace->ran(started);
+    });
 }
 
 } /* adio */
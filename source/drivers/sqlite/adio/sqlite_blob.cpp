@@ -0,0 +1,192 @@
+#include <adio/sqlite_blob.hpp>
+
+#include <sqlite3.h>
+
+#include <algorithm>
+
+using namespace adio;
+
+namespace adio
+{
+
+namespace detail
+{
+
+struct sqlite_blob_private
+{
+    ::sqlite3_blob* blob = nullptr;
+    std::size_t offset = 0;
+    std::size_t size = 0;
+
+    void close()
+    {
+        if (blob) ::sqlite3_blob_close(blob);
+        blob = nullptr;
+        offset = size = 0;
+    }
+
+    ~sqlite_blob_private() { close(); }
+};
+
+} /* detail */
+
+} /* adio */
+
+namespace
+{
+
+error_code blob_error(int rc)
+{
+    return make_error_code(static_cast<sqlite_errc>(rc));
+}
+
+} /* anonymous namespace */
+
+sqlite_blob::sqlite_blob(sqlite::connection& con)
+    : _con{con.driver().shared_from_this()}
+    , _private{std::make_shared<detail::sqlite_blob_private>()}
+{
+}
+
+// Pending asynchronous operations keep the handle open until they complete
+sqlite_blob::~sqlite_blob() { _close_on_lane(); }
+
+sqlite_blob& sqlite_blob::operator=(sqlite_blob&& other)
+{
+    if (this == &other) return *this;
+    _close_on_lane();
+    _con = std::move(other._con);
+    _private = std::move(other._private);
+    return *this;
+}
+
+void sqlite_blob::_close_on_lane()
+{
+    // Nothing to close if moved from, or if closed with no operations
+    // pending. Pending operations may still open the handle.
+    if (!_private || (_private.use_count() == 1 && !_private->blob)) return;
+    _con->_push_task(sqlite_op_kind::other,
+                     [ con = _con, p = std::move(_private) ] { p->close(); });
+}
+
+void sqlite_blob::_open(sqlite& con,
+                        detail::sqlite_blob_private& p,
+                        const string& table,
+                        const string& column,
+                        std::int64_t rowid,
+                        sqlite_blob_access access,
+                        const string& database,
+                        error_code& ec)
+{
+    ec = {};
+    p.close();
+    const auto db = con.native_handle();
+    if (!db)
+    {
+        ec = make_error_code(adio::sys_errc::not_connected);
+        return;
+    }
+    const auto rc
+        = ::sqlite3_blob_open(db,
+                              database.data(),
+                              table.data(),
+                              column.data(),
+                              rowid,
+                              access == sqlite_blob_access::read_write,
+                              &p.blob);
+    if (rc != SQLITE_OK)
+    {
+        // SQLite may hand back a handle even on failure
+        p.close();
+        ec = blob_error(rc);
+        return;
+    }
+    p.size = static_cast<std::size_t>(::sqlite3_blob_bytes(p.blob));
+}
+
+void sqlite_blob::reopen(std::int64_t rowid, error_code& ec)
+{
+    ec = {};
+    auto& p = *_private;
+    if (!p.blob)
+    {
+        ec = make_error_code(adio::sys_errc::bad_file_descriptor);
+        return;
+    }
+    const auto rc = ::sqlite3_blob_reopen(p.blob, rowid);
+    if (rc != SQLITE_OK)
+    {
+        // The handle can't be used again after a failed reopen
+        p.close();
+        ec = blob_error(rc);
+        return;
+    }
+    p.offset = 0;
+    p.size = static_cast<std::size_t>(::sqlite3_blob_bytes(p.blob));
+}
+
+bool sqlite_blob::is_open() const { return _private->blob != nullptr; }
+
+void sqlite_blob::close() { _private->close(); }
+
+std::size_t sqlite_blob::size() const { return _private->size; }
+
+std::size_t sqlite_blob::tell() const { return _private->offset; }
+
+void sqlite_blob::seek(std::size_t offset)
+{
+    if (offset > _private->size)
+        throw std::out_of_range{"Cannot seek past the end of a blob"};
+    _private->offset = offset;
+}
+
+std::size_t sqlite_blob::_read_chunk(detail::sqlite_blob_private& p,
+                                     void* data,
+                                     std::size_t size,
+                                     error_code& ec)
+{
+    if (!p.blob)
+    {
+        ec = make_error_code(adio::sys_errc::bad_file_descriptor);
+        return 0;
+    }
+    // Blob sizes are limited to an int, so the remainder always fits
+    const auto n = std::min(size, p.size - p.offset);
+    if (n == 0) return 0;
+    const auto rc
+        = ::sqlite3_blob_read(p.blob, data, int(n), int(p.offset));
+    if (rc != SQLITE_OK)
+    {
+        ec = blob_error(rc);
+        return 0;
+    }
+    p.offset += n;
+    return n;
+}
+
+std::size_t sqlite_blob::_write_chunk(detail::sqlite_blob_private& p,
+                                      const void* data,
+                                      std::size_t size,
+                                      error_code& ec)
+{
+    if (!p.blob)
+    {
+        ec = make_error_code(adio::sys_errc::bad_file_descriptor);
+        return 0;
+    }
+    const auto n = std::min(size, p.size - p.offset);
+    if (n == 0)
+    {
+        ec = make_error_code(adio::sys_errc::file_too_large);
+        return 0;
+    }
+    const auto rc
+        = ::sqlite3_blob_write(p.blob, data, int(n), int(p.offset));
+    if (rc != SQLITE_OK)
+    {
+        ec = blob_error(rc);
+        return 0;
+    }
+    p.offset += n;
+    return n;
+}
@@ -0,0 +1,302 @@
+#ifndef ADIO_SQLITE_BLOB_HPP_INCLUDED
+#define ADIO_SQLITE_BLOB_HPP_INCLUDED
+
+#include <adio/connection.hpp>
+#include <adio/sqlite.hpp>
+
+#include <cstdint>
+#include <memory>
+
+namespace adio
+{
+
+/// Whether a ``sqlite_blob`` may be written to
+enum class sqlite_blob_access
+{
+    read_only,
+    read_write,
+};
+
+namespace detail
+{
+struct sqlite_blob_private;
+} /* detail */
+
+/**
+ * A stream over a single BLOB (or TEXT) value in a SQLite database, using
+ * SQLite's incremental BLOB I/O.
+ *
+ * Meets the requirements of Asio's ``SyncReadStream``, ``SyncWriteStream``,
+ * ``AsyncReadStream`` and ``AsyncWriteStream``, so it can be used with
+ * ``asio::read``, ``asio::async_write`` and friends. Values are transferred a
+ * buffer at a time, without ever holding the whole value in memory.
+ *
+ * The stream reads and writes from a current position, starting at zero.
+ * Reads at the end of the value fail with ``asio::error::eof``. A BLOB can't
+ * change size through the stream: writes past the end fail with
+ * ``sys_errc::file_too_large``. To write a new value, first set the column to
+ * a ``zeroblob(N)`` of the right size.
+ *
+ * Asynchronous operations run on the connection's lane of the
+ * ``sqlite_service`` thread pool. If the row is changed by another statement
+ * while the stream is open, reads and writes fail with ``sqlite_errc::abort``.
+ */
+class sqlite_blob
+{
+    std::shared_ptr<sqlite> _con;
+    std::shared_ptr<detail::sqlite_blob_private> _private;
+
+    static std::size_t _read_chunk(detail::sqlite_blob_private&,
+                                   void* data,
+                                   std::size_t size,
+                                   error_code& ec);
+    static std::size_t _write_chunk(detail::sqlite_blob_private&,
+                                    const void* data,
+                                    std::size_t size,
+                                    error_code& ec);
+
+    template <typename MutableBufferSequence>
+    static std::size_t _read(detail::sqlite_blob_private& p,
+                             const MutableBufferSequence& buffers,
+                             error_code& ec)
+    {
+        ec = {};
+        std::size_t total = 0;
+        std::size_t requested = 0;
+        for (auto it = buffers.begin(); it != buffers.end(); ++it)
+        {
+            const asio::mutable_buffer buf{*it};
+            const auto size = asio::buffer_size(buf);
+            requested += size;
+            if (size == 0) continue;
+            const auto n
+                = _read_chunk(p, asio::buffer_cast<void*>(buf), size, ec);
+            total += n;
+            if (ec || n < size) break;
+        }
+        if (!ec && total == 0 && requested != 0) ec = asio::error::eof;
+        return total;
+    }
+
+    template <typename ConstBufferSequence>
+    static std::size_t _write(detail::sqlite_blob_private& p,
+                              const ConstBufferSequence& buffers,
+                              error_code& ec)
+    {
+        ec = {};
+        std::size_t total = 0;
+        for (auto it = buffers.begin(); it != buffers.end(); ++it)
+        {
+            const asio::const_buffer buf{*it};
+            const auto size = asio::buffer_size(buf);
+            if (size == 0) continue;
+            const auto n = _write_chunk(
+                p, asio::buffer_cast<const void*>(buf), size, ec);
+            total += n;
+            if (ec || n < size) break;
+        }
+        return total;
+    }
+
+    static void _open(sqlite& con,
+                      detail::sqlite_blob_private&,
+                      const string& table,
+                      const string& column,
+                      std::int64_t rowid,
+                      sqlite_blob_access access,
+                      const string& database,
+                      error_code& ec);
+    /// Close the handle on the connection's lane, once any operations
+    /// already queued there have finished with it
+    void _close_on_lane();
+
+public:
+    using open_handler_signature = void(error_code);
+    using read_handler_signature = void(error_code, std::size_t);
+    using write_handler_signature = void(error_code, std::size_t);
+
+    /// Create a closed stream on a connection
+    explicit sqlite_blob(sqlite::connection& con);
+    /// An open handle is closed on the connection's lane
+    ~sqlite_blob();
+    sqlite_blob(sqlite_blob&&) = default;
+    sqlite_blob& operator=(sqlite_blob&&);
+
+    io_service& get_io_service() { return _con->_parent_ios; }
+
+    /** Open the value in ``column`` of the row ``rowid`` of ``table``.
+     *
+     * @param database The attached database containing the table
+     */
+    void open(const string& table,
+              const string& column,
+              std::int64_t rowid,
+              sqlite_blob_access access,
+              error_code& ec,
+              const string& database = "main")
+    {
+        _open(*_con, *_private, table, column, rowid, access, database, ec);
+    }
+    void open(const string& table,
+              const string& column,
+              std::int64_t rowid,
+              sqlite_blob_access access = sqlite_blob_access::read_only,
+              const string& database = "main")
+    {
+        error_code ec;
+        open(table, column, rowid, access, ec, database);
+        detail::throw_if_error(ec, "Failed to open blob");
+    }
+    /// Open a value on the connection's lane
+    template <typename Handler>
+    auto async_open(const string& table,
+                    const string& column,
+                    std::int64_t rowid,
+                    sqlite_blob_access access,
+                    const string& database,
+                    Handler&& handler)
+        -> decltype(std::declval<handler_helper<open_handler_signature,
+                                                handler_decay<Handler>>&>()
+                        .result.get())
+    {
+        handler_helper<open_handler_signature, handler_decay<Handler>> init{
+            std::forward<Handler>(handler)};
+        auto& ios = get_io_service();
+        _con->_push_task(sqlite_op_kind::other, [
+            con = _con,
+            p = _private,
+            work_pin = detail::make_work(ios),
+            table,
+            column,
+            rowid,
+            access,
+            database,
+            handler = init.handler
+        ] {
+            error_code ec;
+            _open(*con, *p, table, column, rowid, access, database, ec);
+            con->_post_handler(std::bind(handler, ec));
+        });
+        return init.result.get();
+    }
+    template <typename Handler>
+    auto async_open(const string& table,
+                    const string& column,
+                    std::int64_t rowid,
+                    sqlite_blob_access access,
+                    Handler&& handler)
+        -> decltype(std::declval<handler_helper<open_handler_signature,
+                                                handler_decay<Handler>>&>()
+                        .result.get())
+    {
+        return async_open(table,
+                          column,
+                          rowid,
+                          access,
+                          "main",
+                          std::forward<Handler>(handler));
+    }
+
+    /// Move the stream to another row of the same table and column, which
+    /// is faster than opening it again
+    void reopen(std::int64_t rowid, error_code& ec);
+    void reopen(std::int64_t rowid)
+    {
+        error_code ec;
+        reopen(rowid, ec);
+        detail::throw_if_error(ec, "Failed to reopen blob");
+    }
+
+    bool is_open() const;
+    void close();
+
+    /// The size of the value in bytes
+    std::size_t size() const;
+    /// The current read/write position
+    std::size_t tell() const;
+    /// Set the read/write position. It may be at most ``size()``.
+    void seek(std::size_t offset);
+
+    template <typename MutableBufferSequence>
+    std::size_t read_some(const MutableBufferSequence& buffers, error_code& ec)
+    {
+        return _read(*_private, buffers, ec);
+    }
+    template <typename MutableBufferSequence>
+    std::size_t read_some(const MutableBufferSequence& buffers)
+    {
+        error_code ec;
+        const auto n = read_some(buffers, ec);
+        detail::throw_if_error(ec, "Failed to read blob");
+        return n;
+    }
+
+    template <typename ConstBufferSequence>
+    std::size_t write_some(const ConstBufferSequence& buffers, error_code& ec)
+    {
+        return _write(*_private, buffers, ec);
+    }
+    template <typename ConstBufferSequence>
+    std::size_t write_some(const ConstBufferSequence& buffers)
+    {
+        error_code ec;
+        const auto n = write_some(buffers, ec);
+        detail::throw_if_error(ec, "Failed to write blob");
+        return n;
+    }
+
+    /// Read from the value on the connection's lane. As with other Asio
+    /// streams, the handler signature is ``void(error_code, std::size_t)``.
+    template <typename MutableBufferSequence, typename Handler>
+    auto async_read_some(const MutableBufferSequence& buffers,
+                         Handler&& handler)
+        -> decltype(std::declval<handler_helper<read_handler_signature,
+                                                handler_decay<Handler>>&>()
+                        .result.get())
+    {
+        handler_helper<read_handler_signature, handler_decay<Handler>> init{
+            std::forward<Handler>(handler)};
+        auto& ios = get_io_service();
+        _con->_push_task(sqlite_op_kind::other, [
+            con = _con,
+            p = _private,
+            work_pin = detail::make_work(ios),
+            buffers,
+            handler = init.handler
+        ] {
+            error_code ec;
+            const auto n = _read(*p, buffers, ec);
+            con->_post_handler(std::bind(handler, ec, n));
+        });
+        return init.result.get();
+    }
+
+    /// Write to the value on the connection's lane
+    template <typename ConstBufferSequence, typename Handler>
+    auto async_write_some(const ConstBufferSequence& buffers,
+                          Handler&& handler)
+        -> decltype(std::declval<handler_helper<write_handler_signature,
+                                                handler_decay<Handler>>&>()
+                        .result.get())
+    {
+        handler_helper<write_handler_signature, handler_decay<Handler>> init{
+            std::forward<Handler>(handler)};
+        auto& ios = get_io_service();
+        _con->_push_task(sqlite_op_kind::other, [
+            con = _con,
+            p = _private,
+            work_pin = detail::make_work(ios),
+            buffers,
+            handler = init.handler
+        ] {
+            error_code ec;
+            const auto n = _write(*p, buffers, ec);
+            con->_post_handler(std::bind(handler, ec, n));
+        });
+        return init.result.get();
+    }
+};
+
+} /* adio */
+
+#endif  // ADIO_SQLITE_BLOB_HPP_INCLUDED
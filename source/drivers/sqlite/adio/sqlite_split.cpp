@@ -0,0 +1,219 @@
+#include <adio/sqlite_split.hpp>
+
+#include <sqlite3.h>
+
+#include <algorithm>
+#include <cctype>
+
+using namespace adio;
+
+namespace
+{
+
+/// Classified SQL remembered by a split connection, beyond which the
+/// remembered routes are forgotten and classified again
+constexpr std::size_t max_routes = 1024;
+
+/// Read the next keyword of ``sql`` from ``it``, in upper case, skipping
+/// whitespace and comments before it. Empty if the next token isn't a word.
+string next_keyword(string::const_iterator& it, string::const_iterator end)
+{
+    while (it != end)
+    {
+        if (std::isspace(static_cast<unsigned char>(*it)))
+            ++it;
+        else if (end - it >= 2 && *it == '-' && it[1] == '-')
+            it = std::find(it, end, '\n');
+        else if (end - it >= 2 && *it == '/' && it[1] == '*')
+        {
+            const string close{"*/"};
+            it = std::search(it + 2, end, close.begin(), close.end());
+            if (it != end) it += 2;
+        }
+        else
+            break;
+    }
+    string keyword;
+    for (; it != end && std::isalpha(static_cast<unsigned char>(*it)); ++it)
+        keyword += char(std::toupper(static_cast<unsigned char>(*it)));
+    return keyword;
+}
+
+/// What a statement does to the transaction on its connection
+enum class transaction_effect
+{
+    none,
+    begin,
+    savepoint,
+    release,
+    end,
+    /// ``ROLLBACK TO``, which leaves the transaction open
+    rollback_to,
+};
+
+/// How ``sql`` affects the transaction it runs in
+transaction_effect transaction_effect_of(const string& sql)
+{
+    auto it = sql.begin();
+    const auto keyword = next_keyword(it, sql.end());
+    if (keyword == "BEGIN") return transaction_effect::begin;
+    if (keyword == "SAVEPOINT") return transaction_effect::savepoint;
+    if (keyword == "RELEASE") return transaction_effect::release;
+    if (keyword == "COMMIT" || keyword == "END")
+        return transaction_effect::end;
+    if (keyword != "ROLLBACK") return transaction_effect::none;
+    auto next = next_keyword(it, sql.end());
+    if (next == "TRANSACTION") next = next_keyword(it, sql.end());
+    return next == "TO" ? transaction_effect::rollback_to
+                        : transaction_effect::end;
+}
+
+/// Whether ``sql`` attaches or detaches a database. SQLite counts these as
+/// read-only statements, but they change the connection they run on, so
+/// must run on the writer.
+bool is_attach(const string& sql)
+{
+    auto it = sql.begin();
+    const auto keyword = next_keyword(it, sql.end());
+    return keyword == "ATTACH" || keyword == "DETACH";
+}
+
+} /* anonymous namespace */
+
+sqlite_split_connection::sqlite_split_connection(io_service& ios,
+                                                 std::size_t readers)
+    : _writer{ios}
+{
+    for (auto i = 0u; i < readers; ++i)
+        _readers.emplace_back(new connection{ios});
+}
+
+sqlite_open_options
+sqlite_split_connection::_writer_options(sqlite_open_options opts)
+{
+    opts.journal_mode = sqlite_journal_mode::wal;
+    return opts;
+}
+
+sqlite_open_options
+sqlite_split_connection::_reader_options(sqlite_open_options opts)
+{
+    // The writer has already put the database in WAL mode, which is
+    // persistent. A read-only connection could not change it anyway.
+    const auto flags = opts.flags ? opts.flags
+                                  : SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+    opts.flags = (flags & ~(SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE))
+                 | SQLITE_OPEN_READONLY;
+    opts.journal_mode = sqlite_journal_mode::unchanged;
+    return opts;
+}
+
+sqlite_split_connection::connection& sqlite_split_connection::reader()
+{
+    if (_readers.empty()) return _writer;
+    const auto n = _next_reader.fetch_add(1, std::memory_order_relaxed);
+    return *_readers[n % _readers.size()];
+}
+
+sqlite_split_connection::connection&
+sqlite_split_connection::connection_for(const statement& st)
+{
+    const auto handle = st.native_handle();
+    if (!handle)
+        throw std::invalid_argument{"Statement has not been prepared"};
+    const auto db = ::sqlite3_db_handle(handle);
+    if (db == _writer.driver().native_handle()) return _writer;
+    for (auto& r : _readers)
+    {
+        if (db == r->driver().native_handle()) return *r;
+    }
+    throw std::invalid_argument{
+        "Statement was not prepared on this split connection"};
+}
+
+error_code sqlite_split_connection::open(const string& path,
+                                         const sqlite_open_options& opts)
+{
+    auto ec = _writer.open(path, _writer_options(opts));
+    if (ec) return ec;
+    const auto reader_opts = _reader_options(opts);
+    for (auto& r : _readers)
+    {
+        ec = r->open(path, reader_opts);
+        if (ec)
+        {
+            close();
+            return ec;
+        }
+    }
+    return {};
+}
+
+void sqlite_split_connection::close()
+{
+    for (auto& r : _readers) r->close();
+    _writer.close();
+    std::lock_guard<std::mutex> lk{_routes_mutex};
+    _transaction_depth = 0;
+}
+
+sqlite_split_connection::connection&
+sqlite_split_connection::_route(const string& sql)
+{
+    const auto writer_db = _writer.driver().native_handle();
+    if (_readers.empty() || !writer_db) return _writer;
+    // Transaction control is tracked here as well as checked on the writer,
+    // as an asynchronous BEGIN may not have run yet. SQLite counts it as
+    // read-only, but it must run on the writer.
+    const auto effect = transaction_effect_of(sql);
+    if (effect != transaction_effect::none)
+    {
+        std::lock_guard<std::mutex> lk{_routes_mutex};
+        switch (effect)
+        {
+        case transaction_effect::begin:
+            _transaction_depth = std::max<std::size_t>(_transaction_depth, 1);
+            break;
+        case transaction_effect::savepoint:
+            ++_transaction_depth;
+            break;
+        case transaction_effect::release:
+            if (_transaction_depth) --_transaction_depth;
+            break;
+        case transaction_effect::end:
+            _transaction_depth = 0;
+            break;
+        default:
+            break;
+        }
+        return _writer;
+    }
+    if (is_attach(sql)) return _writer;
+    {
+        std::lock_guard<std::mutex> lk{_routes_mutex};
+        // Inside a transaction, reads must see the writer's uncommitted
+        // writes
+        if (_transaction_depth || !::sqlite3_get_autocommit(writer_db))
+            return _writer;
+        const auto it = _routes.find(sql);
+        if (it != _routes.end()) return it->second ? reader() : _writer;
+    }
+    // Compile the SQL on a reader just to classify it. Going around the
+    // reader's statement cache keeps the statement from taking a slot there.
+    const auto reader_db = _readers.front()->driver().native_handle();
+    if (!reader_db) return _writer;
+    ::sqlite3_stmt* st = nullptr;
+    const auto rc = ::sqlite3_prepare_v2(
+        reader_db, sql.data(), int(sql.size()), &st, nullptr);
+    const auto is_read = rc == SQLITE_OK && st && ::sqlite3_stmt_readonly(st);
+    ::sqlite3_finalize(st);
+    // SQL that failed to compile may compile later (eg. once a table exists),
+    // so it isn't remembered
+    if (rc == SQLITE_OK)
+    {
+        std::lock_guard<std::mutex> lk{_routes_mutex};
+        if (_routes.size() >= max_routes) _routes.clear();
+        _routes.emplace(sql, is_read);
+    }
+    return is_read ? reader() : _writer;
+}
@@ -0,0 +1,215 @@
+#ifndef ADIO_SQLITE_SPLIT_HPP_INCLUDED
+#define ADIO_SQLITE_SPLIT_HPP_INCLUDED
+
+#include <adio/connection.hpp>
+#include <adio/sqlite.hpp>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace adio
+{
+
+/**
+ * A composite SQLite connection with one writer and several readers on the
+ * same database file, opened in WAL mode.
+ *
+ * In WAL mode, SQLite allows any number of readers to run at the same time as
+ * a single writer. Each of the connections here has its own serial lane on
+ * the ``sqlite_service`` thread pool, so reads spread across the readers run
+ * in parallel with each other and with writes, instead of queueing behind
+ * them on a single connection.
+ *
+ * Statements are routed when they are prepared. SQL that SQLite reports only
+ * reads the database (``sqlite3_stmt_readonly``) is compiled on the next
+ * reader, in round-robin order. Everything else is compiled on the writer,
+ * including SQL that can't be compiled on a reader (eg. because it refers to
+ * a temporary table on the writer), transaction control (``BEGIN``,
+ * ``COMMIT``, ``SAVEPOINT`` and so on) and ``ATTACH`` and ``DETACH``, which
+ * SQLite counts as read-only. A database attached this way is only attached
+ * to the writer. Executing or stepping a statement through this class runs
+ * it on the connection it was compiled on.
+ *
+ * While a transaction is open on the writer, all statements are compiled on
+ * the writer, so that reads see the transaction's own writes. Transactions
+ * are tracked as their control statements are prepared through this class,
+ * so a read prepared after an asynchronous ``BEGIN`` goes to the writer even
+ * if the ``BEGIN`` hasn't run yet. A prepared ``BEGIN`` or ``COMMIT`` should
+ * therefore be executed once, soon after it is prepared. Releasing several
+ * savepoints at once, by naming an outer one, leaves statements on the
+ * writer until the transaction is committed or rolled back.
+ *
+ * To route a piece of SQL, it is compiled once on a reader and thrown away.
+ * This happens on the calling thread, the first time each piece of SQL is
+ * prepared. The result is remembered for later prepares of the same SQL.
+ */
+class sqlite_split_connection
+{
+public:
+    using connection = sqlite::connection;
+    using statement = sqlite::statement;
+    using row = sqlite::row;
+
+private:
+    connection _writer;
+    std::vector<std::unique_ptr<connection>> _readers;
+    std::atomic<std::size_t> _next_reader{0};
+    std::mutex _routes_mutex;
+    /// Whether each piece of SQL seen so far can run on a reader
+    std::unordered_map<string, bool> _routes;
+    /// Transactions and savepoints opened by SQL prepared through this
+    /// class, and not yet closed. Guarded by ``_routes_mutex``.
+    std::size_t _transaction_depth = 0;
+
+    /// Get the connection to prepare ``sql`` on
+    connection& _route(const string& sql);
+
+    static sqlite_open_options _writer_options(sqlite_open_options opts);
+    static sqlite_open_options _reader_options(sqlite_open_options opts);
+
+    struct open_state
+    {
+        std::mutex mutex;
+        std::size_t remaining;
+        error_code ec;
+        std::function<void(error_code)> done;
+    };
+
+public:
+    /// Create a connection with ``readers`` read-only connections
+    sqlite_split_connection(io_service& ios, std::size_t readers);
+
+    /// The connection used for writes
+    connection& writer() { return _writer; }
+    /// The next reader, in round-robin order. The writer if there are no
+    /// readers.
+    connection& reader();
+    std::size_t reader_count() const { return _readers.size(); }
+
+    /// Get the connection a statement was prepared on
+    connection& connection_for(const statement& st);
+
+    /** Open the writer and all readers on ``path``.
+     *
+     * The writer is opened first, with ``opts`` and WAL journaling. The
+     * readers are then opened read-only with the same options.
+     */
+    error_code open(const string& path, const sqlite_open_options& opts = {});
+
+    template <typename Handler>
+    auto async_open(const string& path,
+                    const sqlite_open_options& opts,
+                    Handler&& handler)
+        -> decltype(std::declval<handler_helper<sqlite::open_handler_signature,
+                                                handler_decay<Handler>>&>()
+                        .result.get())
+    {
+        handler_helper<sqlite::open_handler_signature, handler_decay<Handler>>
+            init{std::forward<Handler>(handler)};
+        std::function<void(error_code)> done = init.handler;
+        const auto reader_opts = _reader_options(opts);
+        _writer.async_open(
+            path, _writer_options(opts), [this, path, reader_opts, done](
+                                             error_code ec) {
+                if (ec || _readers.empty())
+                {
+                    done(ec);
+                    return;
+                }
+                auto state = std::make_shared<open_state>();
+                state->remaining = _readers.size();
+                state->done = done;
+                for (auto& r : _readers)
+                {
+                    r->async_open(path, reader_opts, [state](error_code ec) {
+                        std::unique_lock<std::mutex> lk{state->mutex};
+                        if (ec && !state->ec) state->ec = ec;
+                        if (--state->remaining) return;
+                        lk.unlock();
+                        state->done(state->ec);
+                    });
+                }
+            });
+        return init.result.get();
+    }
+    template <typename Handler>
+    auto async_open(const string& path, Handler&& handler) -> decltype(
+        this->async_open(path,
+                         sqlite_open_options{},
+                         std::forward<Handler>(handler)))
+    {
+        return async_open(path,
+                          sqlite_open_options{},
+                          std::forward<Handler>(handler));
+    }
+
+    void close();
+
+    /// Prepare a statement on a reader, or on the writer if it may write
+    statement prepare(const string& sql, error_code& ec)
+    {
+        return _route(sql).prepare(sql, ec);
+    }
+    statement prepare(const string& sql)
+    {
+        error_code ec;
+        auto st = prepare(sql, ec);
+        detail::throw_if_error(ec,
+                               "Failed to prepare statement: \"" + sql + "\"");
+        return st;
+    }
+
+    template <typename Handler>
+    auto async_prepare(const string& sql, Handler&& handler) -> decltype(
+        std::declval<handler_helper<sqlite::prepare_handler_signature,
+                                    handler_decay<Handler>>&>()
+            .result.get())
+    {
+        return _route(sql).async_prepare(sql, std::forward<Handler>(handler));
+    }
+
+    /// Prepare and execute a query on the appropriate connection
+    void execute(const string& sql, error_code& ec)
+    {
+        auto st = prepare(sql, ec);
+        if (!ec) execute(st, ec);
+    }
+    void execute(const string& sql)
+    {
+        auto st = prepare(sql);
+        execute(st);
+    }
+
+// Forward statement operations to the connection that owns the statement
+#define ADIO_SPLIT_DECL_FN(name)                                               \
+    template <typename... Args>                                                \
+    auto name(statement& st, Args&&... args)                                   \
+        ->decltype(std::declval<connection&>().name(                           \
+            st, std::forward<Args>(args)...))                                  \
+    {                                                                          \
+        return connection_for(st).name(st, std::forward<Args>(args)...);       \
+    }                                                                          \
+    template <typename... Args>                                                \
+    auto async_##name(statement& st, Args&&... args)                           \
+        ->decltype(std::declval<connection&>().async_##name(                   \
+            st, std::forward<Args>(args)...))                                  \
+    {                                                                          \
+        return connection_for(st).async_##name(st,                             \
+                                               std::forward<Args>(args)...);   \
+    }                                                                          \
+    static_assert(true, "")
+
+    ADIO_SPLIT_DECL_FN(execute);
+    ADIO_SPLIT_DECL_FN(step);
+    ADIO_SPLIT_DECL_FN(step_batch);
+    ADIO_SPLIT_DECL_FN(execute_batch);
+#undef ADIO_SPLIT_DECL_FN
+};
+
+} /* adio */
+
+#endif  // ADIO_SQLITE_SPLIT_HPP_INCLUDED
@@ -0,0 +1,88 @@
+#include <adio/sqlite_trace.hpp>
+
+#include <algorithm>
+#include <cerrno>
+
+using namespace adio;
+
+sqlite_trace_ring_buffer::sqlite_trace_ring_buffer(std::size_t capacity)
+    : _capacity{capacity}
+{
+    _events.reserve(capacity);
+}
+
+void sqlite_trace_ring_buffer::record(const sqlite_trace_event& event)
+{
+    std::lock_guard<std::mutex> lk{_mutex};
+    ++_recorded;
+    if (_capacity == 0) return;
+    if (_events.size() < _capacity)
+    {
+        _events.push_back(event);
+        return;
+    }
+    _events[_next] = event;
+    _next = (_next + 1) % _capacity;
+}
+
+std::vector<sqlite_trace_event> sqlite_trace_ring_buffer::events() const
+{
+    std::lock_guard<std::mutex> lk{_mutex};
+    std::vector<sqlite_trace_event> ret;
+    ret.reserve(_events.size());
+    ret.insert(ret.end(), _events.begin() + _next, _events.end());
+    ret.insert(ret.end(), _events.begin(), _events.begin() + _next);
+    return ret;
+}
+
+std::uint64_t sqlite_trace_ring_buffer::recorded() const
+{
+    std::lock_guard<std::mutex> lk{_mutex};
+    return _recorded;
+}
+
+void sqlite_trace_ring_buffer::clear()
+{
+    std::lock_guard<std::mutex> lk{_mutex};
+    _events.clear();
+    _next = 0;
+}
+
+sqlite_trace_file::sqlite_trace_file(const string& path)
+    : _file{std::fopen(path.data(), "a")}
+{
+    if (!_file)
+    {
+        detail::throw_if_error(make_error_code(static_cast<sys_errc>(errno)),
+                               "Failed to open trace file \"" + path + "\"");
+    }
+}
+
+sqlite_trace_file::~sqlite_trace_file() { std::fclose(_file); }
+
+void sqlite_trace_file::record(const sqlite_trace_event& event)
+{
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+    auto sql = event.sql;
+    std::replace(sql.begin(), sql.end(), '\n', ' ');
+    std::replace(sql.begin(), sql.end(), '\r', ' ');
+    const long long finished
+        = duration_cast<microseconds>(event.finished.time_since_epoch())
+              .count();
+    const double duration
+        = std::chrono::duration<double, std::micro>(event.duration).count();
+    std::lock_guard<std::mutex> lk{_mutex};
+    std::fprintf(_file,
+                 "%lld\t%.3f\t%p\t%s\n",
+                 finished,
+                 duration,
+                 static_cast<const void*>(event.connection),
+                 sql.data());
+}
+
+void sqlite_trace_file::flush()
+{
+    std::lock_guard<std::mutex> lk{_mutex};
+    std::fflush(_file);
+}
@@ -0,0 +1,92 @@
+#ifndef ADIO_SQLITE_TRACE_HPP_INCLUDED
+#define ADIO_SQLITE_TRACE_HPP_INCLUDED
+
+#include <adio/sqlite.hpp>
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace adio
+{
+
+/**
+ * A trace sink which keeps the most recent statements in memory.
+ *
+ * Once ``capacity()`` statements have been recorded, each new one replaces
+ * the oldest.
+ */
+class sqlite_trace_ring_buffer : public sqlite_trace_sink
+{
+    mutable std::mutex _mutex;
+    std::vector<sqlite_trace_event> _events;
+    // Where the next event goes once the buffer is full
+    std::size_t _next = 0;
+    std::size_t _capacity;
+    std::uint64_t _recorded = 0;
+
+public:
+    explicit sqlite_trace_ring_buffer(std::size_t capacity);
+
+    void record(const sqlite_trace_event& event) override;
+
+    /// Get the statements in the buffer, oldest first
+    std::vector<sqlite_trace_event> events() const;
+    /// The number of statements recorded, including those no longer in the
+    /// buffer
+    std::uint64_t recorded() const;
+    std::size_t capacity() const { return _capacity; }
+    void clear();
+};
+
+/**
+ * A trace sink which appends statements to a file, one per line.
+ *
+ * Each line holds the time the statement finished (in microseconds since the
+ * epoch), how long it ran (in microseconds), the address of the connection
+ * and the SQL, separated by tabs. Line breaks in the SQL are written as
+ * spaces.
+ */
+class sqlite_trace_file : public sqlite_trace_sink
+{
+    std::mutex _mutex;
+    std::FILE* _file = nullptr;
+
+public:
+    /// Open ``path`` for appending. Throws if the file can't be opened.
+    explicit sqlite_trace_file(const string& path);
+    sqlite_trace_file(const sqlite_trace_file&) = delete;
+    sqlite_trace_file& operator=(const sqlite_trace_file&) = delete;
+    ~sqlite_trace_file();
+
+    void record(const sqlite_trace_event& event) override;
+    /// Write buffered lines out to the file
+    void flush();
+};
+
+/// A trace sink which passes statements to a function
+class sqlite_trace_callback : public sqlite_trace_sink
+{
+public:
+    using callback_type = std::function<void(const sqlite_trace_event&)>;
+
+private:
+    callback_type _callback;
+
+public:
+    explicit sqlite_trace_callback(callback_type cb)
+        : _callback{std::move(cb)}
+    {
+    }
+
+    void record(const sqlite_trace_event& event) override
+    {
+        _callback(event);
+    }
+};
+
+} /* adio */
+
+#endif  // ADIO_SQLITE_TRACE_HPP_INCLUDED
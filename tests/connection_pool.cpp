@@ -0,0 +1,128 @@
+#include <catch/catch.hpp>
+
+#include <adio/connection_pool.hpp>
+#include <adio/sqlite.hpp>
+
+#include <thread>
+
+using pool_type = adio::connection_pool<adio::sqlite>;
+
+TEST_CASE("Acquire a pooled connection")
+{
+    adio::io_service ios;
+    pool_type pool{ios, adio::pool_options{}, "pool.db"};
+    bool did_acquire = false;
+    pool.async_acquire([&](pool_type::lease l, adio::error_code ec) {
+        CHECK_FALSE(ec);
+        REQUIRE(l);
+        l->execute("CREATE TABLE IF NOT EXISTS pooled (id INTEGER)");
+        did_acquire = true;
+    });
+    ios.run();
+    CHECK(did_acquire);
+    CHECK(pool.size() == 1);
+    CHECK(pool.idle_count() == 1);
+}
+
+TEST_CASE("Pooled connections are reused")
+{
+    adio::io_service ios;
+    adio::pool_options opts;
+    opts.max_size = 1;
+    pool_type pool{ios, opts, "pool.db"};
+    std::vector<pool_type::connection*> seen;
+    for (auto i = 0; i < 4; ++i)
+    {
+        pool.async_acquire([&](pool_type::lease l, adio::error_code ec) {
+            CHECK_FALSE(ec);
+            seen.push_back(&*l);
+        });
+    }
+    ios.run();
+    REQUIRE(seen.size() == 4);
+    for (auto con : seen) CHECK(con == seen[0]);
+    CHECK(pool.size() == 1);
+}
+
+TEST_CASE("Pool waits for a connection at its limit")
+{
+    adio::io_service ios;
+    adio::pool_options opts;
+    opts.max_size = 1;
+    pool_type pool{ios, opts, "pool.db"};
+    pool_type::lease held;
+    bool second_acquired = false;
+    pool.async_acquire([&](pool_type::lease l, adio::error_code) {
+        held = std::move(l);
+        pool.async_acquire([&](pool_type::lease l, adio::error_code ec) {
+            CHECK_FALSE(ec);
+            CHECK(l);
+            second_acquired = true;
+        });
+    });
+    ios.run();
+    CHECK_FALSE(second_acquired);
+    ios.reset();
+    held.release();
+    ios.run();
+    CHECK(second_acquired);
+}
+
+TEST_CASE("Pool warms up and reaps idle connections")
+{
+    adio::io_service ios;
+    adio::pool_options opts;
+    opts.min_size = 2;
+    opts.idle_timeout = std::chrono::seconds{0};
+    pool_type pool{ios, opts, "pool.db"};
+    ios.run();
+    CHECK(pool.idle_count() == 2);
+    pool.reap();
+    CHECK(pool.size() == 2);
+}
+
+TEST_CASE("Pool reaps idle connections above its minimum size")
+{
+    adio::io_service ios;
+    adio::pool_options opts;
+    opts.min_size = 1;
+    // Long enough that returning the connections doesn't reap them
+    opts.idle_timeout = std::chrono::milliseconds{50};
+    pool_type pool{ios, opts, "pool.db"};
+    ios.run();
+    ios.reset();
+    std::vector<pool_type::lease> held;
+    for (auto i = 0; i < 3; ++i)
+    {
+        pool.async_acquire([&](pool_type::lease l, adio::error_code ec) {
+            CHECK_FALSE(ec);
+            held.push_back(std::move(l));
+        });
+    }
+    ios.run();
+    REQUIRE(held.size() == 3);
+    CHECK(pool.size() == 3);
+    held.clear();
+    CHECK(pool.idle_count() == 3);
+    pool.reap();
+    CHECK(pool.size() == 3);
+
+    std::this_thread::sleep_for(opts.idle_timeout * 2);
+    pool.reap();
+    CHECK(pool.size() == 1);
+    CHECK(pool.idle_count() == 1);
+}
+
+TEST_CASE("Pool reports open errors")
+{
+    adio::io_service ios;
+    pool_type pool{ios, adio::pool_options{}, "nonexistent-dir/foo.db"};
+    adio::error_code ec;
+    pool.async_acquire([&](pool_type::lease l, adio::error_code e) {
+        CHECK_FALSE(l);
+        ec = e;
+    });
+    ios.run();
+    CHECK(ec == adio::sqlite_errc::cant_open);
+    CHECK(pool.size() == 0);
+}
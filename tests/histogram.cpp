@@ -0,0 +1,55 @@
+#include <catch/catch.hpp>
+
+#include <adio/histogram.hpp>
+
+using std::chrono::nanoseconds;
+
+
+TEST_CASE("Histogram buckets")
+{
+    using h = adio::latency_histogram;
+    for (std::uint64_t v : {0ull, 1ull, 31ull, 32ull, 33ull, 1000ull,
+                            123456789ull, ~0ull})
+    {
+        const auto b = h::bucket_for(v);
+        REQUIRE(b < h::bucket_count);
+        CHECK(h::bucket_lowest(b) <= v);
+        CHECK(h::bucket_highest(b) >= v);
+    }
+    // Buckets are contiguous
+    for (auto i = 1u; i < h::bucket_count; ++i)
+    {
+        REQUIRE(h::bucket_lowest(i) == h::bucket_highest(i - 1) + 1);
+    }
+    CHECK(h::bucket_highest(h::bucket_count - 1) == ~0ull);
+}
+
+TEST_CASE("Histogram percentiles")
+{
+    adio::latency_histogram hist;
+    CHECK(hist.snapshot().count() == 0);
+    CHECK(hist.snapshot().percentile(0.5) == nanoseconds{0});
+
+    for (auto i = 1; i <= 1000; ++i) hist.record(nanoseconds{i * 1000});
+    hist.record(nanoseconds{-5});
+    auto snap = hist.snapshot();
+    CHECK(snap.count() == 1001);
+    CHECK(snap.max() == nanoseconds{1000000});
+    CHECK(snap.sum() == nanoseconds{500500000});
+    const auto near = [](nanoseconds got, double want) {
+        return std::abs(double(got.count()) - want) <= want * 0.035;
+    };
+    CHECK(near(snap.percentile(0.5), 500000));
+    CHECK(near(snap.percentile(0.99), 990000));
+    CHECK(snap.percentile(1.0) == nanoseconds{1000000});
+    CHECK(snap.percentile(0.0) == nanoseconds{0});
+
+    auto twice = snap;
+    twice += snap;
+    CHECK(twice.count() == 2002);
+    CHECK(near(twice.percentile(0.5), 500000));
+
+    hist.reset();
+    CHECK(hist.snapshot().count() == 0);
+    CHECK(hist.snapshot().max() == nanoseconds{0});
+}
@@ -0,0 +1,141 @@
+#include <catch/catch.hpp>
+
+#include <adio/connection.hpp>
+#include <adio/mock.hpp>
+
+#include <boost/asio/spawn.hpp>
+
+#include <chrono>
+
+#define DECL_CON                                                               \
+    adio::io_service ios;                                                      \
+    adio::mock_driver::connection con { ios }
+
+TEST_CASE("Run queries on the mock driver")
+{
+    DECL_CON;
+    adio::mock_options opts;
+    opts.rows = 3;
+    opts.columns = 2;
+    con.driver().set_options(opts);
+
+    CHECK_FALSE(con.open("mock"));
+    CHECK(con.driver().is_open());
+    auto st = con.prepare("SELECT a, b FROM t");
+    CHECK(st.sql() == "SELECT a, b FROM t");
+    for (int n = 0; n < 3; ++n)
+    {
+        auto r = con.step(st);
+        REQUIRE(r.size() == 2);
+        CHECK(r[0] == n);
+        CHECK(r[1] == n + 1);
+    }
+    CHECK(con.step(st).size() == 0);
+    CHECK(st.done());
+    con.execute("DELETE FROM t");
+
+    const auto& stats = con.driver().stats();
+    CHECK(stats.opens == 1);
+    CHECK(stats.prepares == 1);
+    CHECK(stats.steps == 4);
+    CHECK(stats.executes == 1);
+    CHECK(stats.errors == 0);
+    con.close();
+    CHECK_FALSE(con.driver().is_open());
+}
+
+TEST_CASE("Async queries on the mock driver")
+{
+    DECL_CON;
+    int rows = 0;
+    bool done = false;
+    con.async_open("mock", [&](adio::error_code ec) {
+        CHECK_FALSE(ec);
+        con.async_prepare("SELECT 1", [&](adio::mock_statement st,
+                                          adio::error_code ec) {
+            CHECK_FALSE(ec);
+            auto st_ptr = std::make_shared<adio::mock_statement>(std::move(st));
+            con.async_step(*st_ptr, [&, st_ptr](adio::row r,
+                                                adio::error_code ec) {
+                CHECK_FALSE(ec);
+                rows += r.size() != 0;
+                con.async_execute(*st_ptr, [&, st_ptr](adio::error_code ec) {
+                    CHECK_FALSE(ec);
+                    done = st_ptr->done();
+                });
+            });
+        });
+    });
+    ios.run();
+    CHECK(rows == 1);
+    CHECK(done);
+}
+
+TEST_CASE("Spawn queries on the mock driver")
+{
+    DECL_CON;
+    bool worked = false;
+    adio::asio::spawn(ios, [&](adio::asio::yield_context yc) {
+        con.async_open("mock", yc);
+        con.async_execute("INSERT INTO t VALUES (1)", yc);
+        worked = true;
+    });
+    ios.run();
+    CHECK(worked);
+}
+
+TEST_CASE("Inject errors with the mock driver")
+{
+    DECL_CON;
+    adio::mock_options opts;
+    opts.error_rate = 1;
+    opts.error = make_error_code(adio::sys_errc::timed_out);
+    con.driver().set_options(opts);
+
+    CHECK(con.open("mock") == adio::sys_errc::timed_out);
+    CHECK_THROWS_AS(con.prepare("SELECT 1"), adio::system_error);
+
+    adio::error_code async_ec;
+    con.async_execute("SELECT 1", [&](adio::error_code ec) { async_ec = ec; });
+    ios.run();
+    CHECK(async_ec == adio::sys_errc::timed_out);
+    CHECK(con.driver().stats().errors == 3);
+
+    // Some, but not all, operations fail at a rate in between
+    opts.error_rate = 0.5;
+    con.driver().set_options(opts);
+    con.driver().reset_stats();
+    for (int n = 0; n < 1000; ++n)
+    {
+        adio::error_code ec;
+        con.execute("SELECT 1", ec);
+    }
+    CHECK(con.driver().stats().errors > 400);
+    CHECK(con.driver().stats().errors < 600);
+}
+
+TEST_CASE("Inject service time with the mock driver")
+{
+    using namespace std::chrono;
+    DECL_CON;
+    adio::mock_options opts;
+    opts.service_time = milliseconds{20};
+    opts.jitter = milliseconds{5};
+    con.driver().set_options(opts);
+
+    auto start = steady_clock::now();
+    con.execute("SELECT 1");
+    CHECK(steady_clock::now() - start >= milliseconds{20});
+
+    // Asynchronous operations wait on a timer, so the thread is free to run
+    // other handlers in the meantime
+    bool finished = false;
+    bool ran_between = false;
+    start = steady_clock::now();
+    con.async_execute("SELECT 1", [&](adio::error_code) { finished = true; });
+    ios.post([&] { ran_between = !finished; });
+    ios.run();
+    CHECK(finished);
+    CHECK(ran_between);
+    CHECK(steady_clock::now() - start >= milliseconds{20});
+}
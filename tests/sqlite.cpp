@@ -2,9 +2,17 @@
 
 #include <adio/connection.hpp>
 #include <adio/sqlite.hpp>
+#include <adio/sqlite_blob.hpp>
+#include <adio/sqlite_split.hpp>
+#include <adio/sqlite_trace.hpp>
 
 #include <boost/asio/spawn.hpp>
 
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+
 #define DECL_CON                                                               \
     adio::io_service ios;                                                      \
     adio::sqlite::connection con { ios }
@@ -238,3 +246,1317 @@ TEST_CASE("Bind named parameters")
     REQUIRE(rows.size() == 1);
     CHECK(rows[0] == "top");
 }
+
+
+TEST_CASE("Async operations on a connection run in order")
+{
+    DECL_OPEN;
+    con.execute("DROP TABLE IF EXISTS seq");
+    con.execute("CREATE TABLE seq (n INTEGER NOT NULL)");
+    std::vector<adio::sqlite::statement> inserts;
+    for (auto i = 0; i < 50; ++i)
+    {
+        inserts.push_back(con.prepare("INSERT INTO seq (n) VALUES (?)"));
+        inserts.back().bind(1, adio::value{adio::value::integer{i}});
+    }
+    std::vector<int> completed;
+    for (auto i = 0; i < 50; ++i)
+    {
+        con.async_execute(inserts[i], [&, i](adio::error_code ec) {
+            CHECK_FALSE(ec);
+            completed.push_back(i);
+        });
+    }
+    ios.run();
+    REQUIRE(completed.size() == 50);
+    auto st = con.prepare("SELECT n FROM seq ORDER BY rowid");
+    std::vector<int> stored{begin(st), end(st)};
+    REQUIRE(stored.size() == 50);
+    for (auto i = 0; i < 50; ++i)
+    {
+        CHECK(completed[i] == i);
+        CHECK(stored[i] == i);
+    }
+}
+
+
+TEST_CASE("Prepared statements are cached")
+{
+    DECL_OPEN;
+    con.execute("DROP TABLE IF EXISTS cached");
+    con.execute("CREATE TABLE cached (n INTEGER)");
+    const auto before = con.driver().statement_cache_stats();
+    for (auto i = 0; i < 10; ++i)
+    {
+        auto st = con.prepare("INSERT INTO cached (n) VALUES (?)");
+        st.bind(1, adio::value{adio::value::integer{i}});
+        st.execute();
+    }
+    const auto after = con.driver().statement_cache_stats();
+    CHECK(after.misses - before.misses == 1);
+    CHECK(after.hits - before.hits == 9);
+    auto st = con.prepare("SELECT COUNT(*) FROM cached");
+    std::vector<int> counts{begin(st), end(st)};
+    REQUIRE(counts.size() == 1);
+    CHECK(counts[0] == 10);
+}
+
+
+TEST_CASE("Statement cache is bounded")
+{
+    DECL_OPEN;
+    con.driver().set_statement_cache_capacity(2);
+    con.prepare("SELECT 1");
+    con.prepare("SELECT 2");
+    con.prepare("SELECT 3");
+    auto stats = con.driver().statement_cache_stats();
+    CHECK(stats.size == 2);
+    CHECK(stats.capacity == 2);
+    const auto misses = stats.misses;
+    // "SELECT 1" was evicted, "SELECT 3" was not
+    con.prepare("SELECT 1");
+    con.prepare("SELECT 3");
+    stats = con.driver().statement_cache_stats();
+    CHECK(stats.misses == misses + 1);
+    con.driver().set_statement_cache_capacity(0);
+    CHECK(con.driver().statement_cache_stats().size == 0);
+}
+
+
+TEST_CASE("Statements in use are not shared")
+{
+    DECL_OPEN;
+    auto st1 = con.prepare("SELECT 12");
+    auto st2 = con.prepare("SELECT 12");
+    std::vector<int> a{begin(st1), end(st1)};
+    std::vector<int> b{begin(st2), end(st2)};
+    CHECK(a == std::vector<int>{12});
+    CHECK(b == std::vector<int>{12});
+}
+
+
+TEST_CASE("Reset and rebind a statement")
+{
+    DECL_OPEN;
+    con.execute("DROP TABLE IF EXISTS reused");
+    con.execute("CREATE TABLE reused (n INTEGER)");
+    auto insert = con.prepare("INSERT INTO reused (n) VALUES (?)");
+    for (auto i = 0; i < 5; ++i)
+    {
+        insert.reset();
+        insert.bind(1, adio::value{adio::value::integer{i}});
+        insert.execute();
+        CHECK(insert.done());
+    }
+    insert.reset();
+    insert.clear_bindings();
+    insert.execute();
+
+    auto select = con.prepare("SELECT COUNT(n), COUNT(*) FROM reused");
+    for (auto pass = 0; pass < 2; ++pass)
+    {
+        select.reset();
+        std::vector<adio::row> rows{begin(select), end(select)};
+        REQUIRE(rows.size() == 1);
+        CHECK(rows[0][0] == 5);
+        CHECK(rows[0][1] == 6);
+    }
+}
+
+
+TEST_CASE("Execute a batch of tuples")
+{
+    DECL_OPEN;
+    con.execute("DROP TABLE IF EXISTS batch");
+    con.execute("CREATE TABLE batch (n INTEGER, name TEXT)");
+    std::vector<std::tuple<int, std::string>> rows;
+    for (auto i = 0; i < 2500; ++i) rows.emplace_back(i, "row");
+    adio::sqlite_batch_options opts;
+    opts.chunk_size = 1000;
+    auto insert = con.prepare("INSERT INTO batch (n, name) VALUES (?, ?)");
+    con.execute_batch(insert, rows, opts);
+    auto st = con.prepare("SELECT COUNT(*), SUM(n) FROM batch");
+    std::vector<adio::row> result{begin(st), end(st)};
+    REQUIRE(result.size() == 1);
+    CHECK(result[0][0] == 2500);
+    CHECK(result[0][1] == 2500 * 2499 / 2);
+}
+
+
+TEST_CASE("Async execute a batch of rows")
+{
+    DECL_OPEN;
+    con.execute("DROP TABLE IF EXISTS batch");
+    con.execute("CREATE TABLE batch (n INTEGER, name TEXT)");
+    std::vector<adio::row> rows;
+    for (auto i = 0; i < 10; ++i)
+    {
+        rows.emplace_back(std::vector<adio::value>{
+            adio::value::integer{i}, adio::value{"row"}});
+    }
+    auto insert = con.prepare("INSERT INTO batch (n, name) VALUES (?, ?)");
+    bool did_run = false;
+    con.async_execute_batch(insert, rows, [&](adio::error_code ec) {
+        CHECK_FALSE(ec);
+        did_run = true;
+    });
+    ios.run();
+    CHECK(did_run);
+    auto st = con.prepare("SELECT COUNT(*) FROM batch");
+    std::vector<int> counts{begin(st), end(st)};
+    CHECK(counts == std::vector<int>{10});
+}
+
+
+TEST_CASE("Failed batch rolls back its chunk")
+{
+    DECL_OPEN;
+    con.execute("DROP TABLE IF EXISTS batch");
+    con.execute("CREATE TABLE batch (n INTEGER PRIMARY KEY)");
+    std::vector<std::tuple<int>> rows{
+        std::make_tuple(1), std::make_tuple(2), std::make_tuple(3),
+        std::make_tuple(3), std::make_tuple(4)};
+    adio::sqlite_batch_options opts;
+    opts.chunk_size = 2;
+    auto insert = con.prepare("INSERT INTO batch (n) VALUES (?)");
+    adio::error_code ec;
+    con.execute_batch(insert, rows, opts, ec);
+    CHECK(ec == adio::sqlite_errc::constraint);
+    auto st = con.prepare("SELECT COUNT(*) FROM batch");
+    std::vector<int> counts{begin(st), end(st)};
+    // The first chunk of two was committed
+    CHECK(counts == std::vector<int>{2});
+}
+
+
+TEST_CASE("Async batch with a row too wide for the statement")
+{
+    DECL_OPEN;
+    con.execute("DROP TABLE IF EXISTS batch");
+    con.execute("CREATE TABLE batch (n INTEGER)");
+    std::vector<std::tuple<int, int>> rows{std::make_tuple(1, 2)};
+    auto insert = con.prepare("INSERT INTO batch (n) VALUES (?)");
+    adio::error_code ec;
+    bool did_run = false;
+    con.async_execute_batch(insert, rows, [&](adio::error_code e) {
+        ec = e;
+        did_run = true;
+    });
+    ios.run();
+    CHECK(did_run);
+    CHECK(ec == adio::sqlite_errc::range);
+    auto st = con.prepare("SELECT COUNT(*) FROM batch");
+    std::vector<int> counts{begin(st), end(st)};
+    CHECK(counts == std::vector<int>{0});
+    // The batch's transaction was rolled back
+    CHECK_FALSE(con.driver().begin().nested());
+}
+
+
+TEST_CASE("Iterate over row views")
+{
+    DECL_OPEN;
+    con.execute("DROP TABLE IF EXISTS viewed");
+    con.execute("CREATE TABLE viewed (id INTEGER, name TEXT, data BLOB)");
+    con.execute(
+        "INSERT INTO viewed VALUES (1, 'cat', x'0102'), (2, NULL, NULL)");
+    auto st = con.prepare("SELECT id, name, data FROM viewed ORDER BY id");
+    int count = 0;
+    for (auto row : st.views())
+    {
+        ++count;
+        REQUIRE(row.size() == 3);
+        CHECK(row.column_name(1) == "name");
+        CHECK(row.integer(0) == count);
+        if (count == 1)
+        {
+            CHECK(row.column_type(1) == adio::type::text);
+            CHECK(row.text(1) == "cat");
+            REQUIRE(row.blob(2).size() == 2);
+            CHECK(row.blob(2)[1] == 2);
+            CHECK(row[1] == "cat");
+        }
+        else
+        {
+            CHECK(row.is_null(1));
+            CHECK(row[2] == adio::null);
+            CHECK(row.to_row().size() == 3);
+        }
+    }
+    CHECK(count == 2);
+}
+
+
+TEST_CASE("Fetch rows into columns")
+{
+    DECL_OPEN;
+    con.execute("DROP TABLE IF EXISTS columnar");
+    con.execute("CREATE TABLE columnar (n INTEGER, x REAL, name TEXT)");
+    std::vector<std::tuple<int, double, std::string>> rows;
+    for (auto i = 0; i < 25; ++i)
+        rows.emplace_back(i, i / 2.0, std::to_string(i));
+    auto insert = con.prepare("INSERT INTO columnar VALUES (?, ?, ?)");
+    con.execute_batch(insert, rows);
+    con.execute("UPDATE columnar SET name = NULL WHERE n = 0");
+
+    auto st = con.prepare("SELECT n, x, name FROM columnar ORDER BY n");
+    adio::column_batch batch;
+    std::size_t total = 0;
+    while (auto n = st.fetch_columns(batch, 10))
+    {
+        REQUIRE(batch.columns.size() == 3);
+        CHECK(batch.columns[0].name == "n");
+        CHECK(batch.columns[0].type() == adio::type::integer);
+        CHECK(batch.columns[1].type() == adio::type::real);
+        CHECK(batch.columns[2].type() == adio::type::text);
+        for (auto i = 0u; i < n; ++i)
+        {
+            const auto expect = static_cast<int>(total + i);
+            CHECK(batch.columns[0].integers[i] == expect);
+            CHECK(batch.columns[1].reals[i] == expect / 2.0);
+            if (expect == 0)
+                CHECK(batch.columns[2].is_null(i));
+            else
+                CHECK(batch.columns[2].text(i) == std::to_string(expect));
+        }
+        total += n;
+    }
+    CHECK(total == 25);
+    CHECK(st.done());
+}
+
+
+TEST_CASE("Fetch typed rows")
+{
+    DECL_OPEN;
+    con.execute("DROP TABLE IF EXISTS typed");
+    con.execute("CREATE TABLE typed (n INTEGER, name TEXT, x REAL)");
+    con.execute("INSERT INTO typed VALUES (1, 'one', 1.5), (2, NULL, 2.5)");
+    auto st = con.prepare("SELECT n, name, x FROM typed ORDER BY n");
+    auto first
+        = st.fetch<std::tuple<std::int64_t, adio::string_view, double>>();
+    REQUIRE(first.is_initialized());
+    CHECK(std::get<0>(*first) == 1);
+    CHECK(std::get<1>(*first) == "one");
+    CHECK(std::get<2>(*first) == 1.5);
+    std::tuple<int, boost::optional<std::string>, float> second;
+    REQUIRE(st.fetch(second));
+    CHECK(std::get<0>(second) == 2);
+    CHECK_FALSE(std::get<1>(second).is_initialized());
+    CHECK(std::get<2>(second) == 2.5f);
+    CHECK_FALSE(st.fetch(second));
+    CHECK(st.done());
+
+    st.reset();
+    std::tuple<int, std::string> too_narrow;
+    CHECK_THROWS_AS(st.fetch(too_narrow), std::invalid_argument);
+    st.reset();
+    st.fetch<std::tuple<int, std::string, double>>();
+    CHECK_THROWS_AS((st.fetch<std::tuple<int, std::string, double>>()),
+                    adio::invalid_access);
+}
+
+
+TEST_CASE("Fetch stays done until reset")
+{
+    DECL_OPEN;
+    auto st = con.prepare("SELECT 1");
+    CHECK(st.fetch<std::tuple<int>>().is_initialized());
+    CHECK_FALSE(st.fetch<std::tuple<int>>().is_initialized());
+    // Fetching again doesn't start the query over
+    CHECK_FALSE(st.fetch<std::tuple<int>>().is_initialized());
+    CHECK(st.done());
+    st.reset();
+    CHECK(st.fetch<std::tuple<int>>().is_initialized());
+}
+
+
+TEST_CASE("Async step delivers the row")
+{
+    DECL_OPEN;
+    auto st = con.prepare("SELECT 42");
+    bool did_run = false;
+    con.async_step(st, [&](adio::sqlite::row r, adio::error_code ec) {
+        CHECK_FALSE(ec);
+        REQUIRE(r.size() == 1);
+        CHECK(r[0] == 42);
+        did_run = true;
+    });
+    ios.run();
+    CHECK(did_run);
+}
+
+
+TEST_CASE("Async step through rows in batches")
+{
+    DECL_OPEN;
+    con.execute("DROP TABLE IF EXISTS streamed");
+    con.execute("CREATE TABLE streamed (n INTEGER)");
+    std::vector<std::tuple<int>> rows;
+    for (auto i = 0; i < 1000; ++i) rows.emplace_back(i);
+    auto insert = con.prepare("INSERT INTO streamed VALUES (?)");
+    con.execute_batch(insert, rows);
+
+    auto st = con.prepare("SELECT n FROM streamed ORDER BY n");
+    int batches = 0;
+    int total = 0;
+    std::function<void(std::vector<adio::sqlite::row>, adio::error_code)>
+        on_rows = [&](std::vector<adio::sqlite::row> rows,
+                      adio::error_code ec) {
+            REQUIRE_FALSE(ec);
+            ++batches;
+            for (auto& r : rows) CHECK(r[0] == total++);
+            if (!st.done()) con.async_step_batch(st, 100, on_rows);
+        };
+    con.async_step_batch(st, 100, on_rows);
+    ios.run();
+    CHECK(total == 1000);
+    CHECK(batches == 11);
+}
+
+
+TEST_CASE("Bind native values")
+{
+    DECL_OPEN;
+    con.execute("DROP TABLE IF EXISTS natives");
+    con.execute(
+        "CREATE TABLE natives (n INTEGER, x REAL, name TEXT, data BLOB, "
+        "maybe INTEGER)");
+    const std::string name = "borrowed";
+    const std::vector<char> payload{'a', 'b', 'c'};
+    auto insert = con.prepare("INSERT INTO natives VALUES (?, ?, ?, ?, ?)");
+    insert.bind_all(7,
+                    2.5,
+                    adio::string_view{name},
+                    adio::blob_view{payload},
+                    boost::optional<int>{});
+    insert.execute();
+    insert.reset();
+    insert.bind_all(8, 3.5f, std::string{"copied"}, payload, 12);
+    insert.execute();
+
+    auto st = con.prepare("SELECT n, x, name, data, maybe FROM natives");
+    std::vector<adio::row> rows{begin(st), end(st)};
+    REQUIRE(rows.size() == 2);
+    CHECK(rows[0][0] == 7);
+    CHECK(rows[0][1] == 2.5);
+    CHECK(rows[0][2] == "borrowed");
+    CHECK(rows[0][3] == adio::value{payload});
+    CHECK(rows[0][4] == adio::null);
+    CHECK(rows[1][2] == "copied");
+    CHECK(rows[1][4] == 12);
+}
+
+
+TEST_CASE("Resolve named parameters")
+{
+    DECL_OPEN;
+    auto st = con.prepare("SELECT :b, ?, @a, :b, $c");
+    CHECK(st.parameter_index(":b") == 1);
+    CHECK(st.parameter_index("@a") == 3);
+    CHECK(st.parameter_index("$c") == 4);
+    CHECK(st.parameter_index(":a") == 0);
+    CHECK(st.parameter_index("b") == 0);
+    st.bind(std::string{":b"}, adio::value{"bee"});
+    st.bind("@a", adio::value{"ay"});
+    CHECK_THROWS_AS(st.bind(":nope", adio::value{}), std::domain_error);
+    std::vector<adio::row> rows{begin(st), end(st)};
+    REQUIRE(rows.size() == 1);
+    CHECK(rows[0][0] == "bee");
+    CHECK(rows[0][2] == "ay");
+    CHECK(rows[0][3] == "bee");
+}
+
+
+TEST_CASE("Open with options")
+{
+    DECL_CON;
+    adio::sqlite_open_options opts;
+    opts.journal_mode = adio::sqlite_journal_mode::wal;
+    opts.synchronous = adio::sqlite_synchronous::normal;
+    opts.temp_store = adio::sqlite_temp_store::memory;
+    opts.cache_size = -4096;
+    opts.busy_timeout = std::chrono::milliseconds{250};
+    auto ec = con.open("options.db", opts);
+    REQUIRE_FALSE(ec);
+    auto mode = con.prepare("PRAGMA journal_mode");
+    std::vector<std::string> modes{begin(mode), end(mode)};
+    CHECK(modes == std::vector<std::string>{"wal"});
+    auto sync = con.prepare("PRAGMA synchronous");
+    std::vector<int> syncs{begin(sync), end(sync)};
+    CHECK(syncs == std::vector<int>{1});
+    auto cache = con.prepare("PRAGMA cache_size");
+    std::vector<int> caches{begin(cache), end(cache)};
+    CHECK(caches == std::vector<int>{-4096});
+}
+
+
+TEST_CASE("Async open with options")
+{
+    DECL_CON;
+    adio::sqlite_open_options opts;
+    opts.journal_mode = adio::sqlite_journal_mode::wal;
+    adio::error_code ec = adio::sqlite_errc::error;
+    // In-memory databases cannot use WAL, so the open must fail rather than
+    // quietly running in another journal mode
+    con.async_open(":memory:", opts, [&](adio::error_code e) { ec = e; });
+    ios.run();
+    CHECK(ec);
+    opts.journal_mode = adio::sqlite_journal_mode::memory;
+    ios.reset();
+    con.async_open(":memory:", opts, [&](adio::error_code e) { ec = e; });
+    ios.run();
+    CHECK_FALSE(ec);
+}
+
+
+TEST_CASE("Split reads and writes")
+{
+    adio::io_service ios;
+    adio::sqlite_split_connection split{ios, 2};
+    auto ec = split.open("split.db");
+    REQUIRE_FALSE(ec);
+    CHECK(split.reader_count() == 2);
+    split.execute("DROP TABLE IF EXISTS split");
+    split.execute("CREATE TABLE split (n INTEGER)");
+    auto insert = split.prepare("INSERT INTO split VALUES (?)");
+    CHECK_FALSE(insert.readonly());
+    CHECK(&split.connection_for(insert) == &split.writer());
+    insert.bind_all(4);
+    split.execute(insert);
+
+    auto select = split.prepare("SELECT n FROM split");
+    CHECK(select.readonly());
+    CHECK(&split.connection_for(select) != &split.writer());
+    auto row = split.step(select);
+    REQUIRE(row.size() == 1);
+    CHECK(row[0] == 4);
+
+    adio::sqlite::connection other{ios};
+    other.open("foo.db");
+    auto foreign = other.prepare("SELECT 1");
+    CHECK_THROWS_AS(split.connection_for(foreign), std::invalid_argument);
+    CHECK_THROWS_AS(split.connection_for(adio::sqlite::statement{}),
+                    std::invalid_argument);
+}
+
+
+TEST_CASE("Split transactions run on the writer")
+{
+    adio::io_service ios;
+    adio::sqlite_split_connection split{ios, 2};
+    REQUIRE_FALSE(split.open("split.db"));
+    split.execute("DROP TABLE IF EXISTS split");
+    split.execute("CREATE TABLE split (n INTEGER)");
+
+    auto begin = split.prepare("BEGIN");
+    CHECK(&split.connection_for(begin) == &split.writer());
+    split.execute(begin);
+    split.execute("INSERT INTO split VALUES (1)");
+    // Reads inside the transaction see its own writes
+    auto inside = split.prepare("SELECT count(*) FROM split");
+    CHECK(&split.connection_for(inside) == &split.writer());
+    CHECK(split.step(inside)[0] == 1);
+    inside.reset();
+    split.execute("ROLLBACK");
+
+    auto after = split.prepare("SELECT count(*) FROM split");
+    CHECK(&split.connection_for(after) != &split.writer());
+    CHECK(split.step(after)[0] == 0);
+
+    // A BEGIN that is still queued moves later reads to the writer
+    adio::sqlite::statement queued_begin;
+    split.async_prepare("BEGIN",
+                        [&](adio::sqlite::statement st, adio::error_code e) {
+                            CHECK_FALSE(e);
+                            queued_begin = std::move(st);
+                        });
+    auto queued = split.prepare("SELECT count(*) FROM split");
+    CHECK(&split.connection_for(queued) == &split.writer());
+    ios.run();
+    split.execute(queued_begin);
+    split.execute("SAVEPOINT inner");
+    split.execute("ROLLBACK TO inner");
+    auto rolled_back_to = split.prepare("SELECT count(*) FROM split");
+    CHECK(&split.connection_for(rolled_back_to) == &split.writer());
+    split.execute("RELEASE inner");
+    split.execute("COMMIT");
+    auto committed = split.prepare("SELECT count(*) FROM split");
+    CHECK(&split.connection_for(committed) != &split.writer());
+
+    // Databases are attached to, and detached from, the writer
+    auto attach = split.prepare("ATTACH 'split_attached.db' AS extra");
+    CHECK(&split.connection_for(attach) == &split.writer());
+    split.execute(attach);
+    split.execute("CREATE TABLE IF NOT EXISTS extra.t (n INTEGER)");
+    auto attached = split.prepare("SELECT count(*) FROM extra.t");
+    CHECK(&split.connection_for(attached) == &split.writer());
+    attached.reset();
+    auto detach = split.prepare(" /* done */ DETACH extra");
+    CHECK(&split.connection_for(detach) == &split.writer());
+    split.execute(detach);
+}
+
+
+TEST_CASE("Async split reads and writes")
+{
+    adio::io_service ios;
+    adio::sqlite_split_connection split{ios, 2};
+    adio::error_code ec = adio::sqlite_errc::error;
+    split.async_open("split.db", [&](adio::error_code e) { ec = e; });
+    ios.run();
+    REQUIRE_FALSE(ec);
+    split.execute("DROP TABLE IF EXISTS split");
+    split.execute("CREATE TABLE split (n INTEGER)");
+
+    adio::sqlite::statement insert, select;
+    split.async_prepare("INSERT INTO split VALUES (9)",
+                        [&](adio::sqlite::statement st, adio::error_code e) {
+                            CHECK_FALSE(e);
+                            insert = std::move(st);
+                        });
+    split.async_prepare("SELECT n FROM split",
+                        [&](adio::sqlite::statement st, adio::error_code e) {
+                            CHECK_FALSE(e);
+                            select = std::move(st);
+                        });
+    ios.reset();
+    ios.run();
+    CHECK(&split.connection_for(insert) == &split.writer());
+    CHECK(&split.connection_for(select) != &split.writer());
+
+    std::vector<adio::row> rows;
+    split.async_execute(insert, [&](adio::error_code e) {
+        CHECK_FALSE(e);
+        split.async_step_batch(
+            select, 10, [&](std::vector<adio::row> rs, adio::error_code e) {
+                CHECK_FALSE(e);
+                rows = std::move(rs);
+            });
+    });
+    ios.reset();
+    ios.run();
+    REQUIRE(rows.size() == 1);
+    CHECK(rows[0][0] == 9);
+}
+
+
+TEST_CASE("Retry busy operations")
+{
+    adio::io_service ios;
+    adio::sqlite::connection locker{ios};
+    adio::sqlite::connection con{ios};
+    REQUIRE_FALSE(locker.open("busy.db"));
+    REQUIRE_FALSE(con.open("busy.db"));
+    locker.execute("DROP TABLE IF EXISTS busy");
+    locker.execute("CREATE TABLE busy (n INTEGER)");
+    auto insert = con.prepare("INSERT INTO busy VALUES (1)");
+
+    // Without retries, the lock is reported right away
+    locker.execute("BEGIN EXCLUSIVE");
+    adio::error_code ec;
+    con.async_execute(insert, [&](adio::error_code e) { ec = e; });
+    ios.run();
+    CHECK(ec == adio::sqlite_errc::busy);
+
+    adio::sqlite_retry_policy retry;
+    retry.max_retries = 2;
+    retry.initial_delay = std::chrono::milliseconds{1};
+    insert.reset();
+    con.async_execute(insert, retry, [&](adio::error_code e) { ec = e; });
+    ios.reset();
+    ios.run();
+    CHECK(ec == adio::sqlite_errc::busy);
+
+    // Release the lock while the insert is backing off
+    retry.max_retries = 1000;
+    retry.max_delay = std::chrono::milliseconds{5};
+    con.driver().set_retry_policy(retry);
+    insert.reset();
+    ec = adio::sqlite_errc::error;
+    con.async_execute(insert, [&](adio::error_code e) { ec = e; });
+    adio::asio::steady_timer timer{ios, std::chrono::milliseconds{30}};
+    timer.async_wait([&](adio::error_code) { locker.execute("COMMIT"); });
+    ios.reset();
+    ios.run();
+    CHECK_FALSE(ec);
+    auto count = con.prepare("SELECT COUNT(*) FROM busy");
+    std::vector<int> counts{begin(count), end(count)};
+    CHECK(counts == std::vector<int>{1});
+
+    ec = adio::sqlite_errc::error;
+    con.async_execute("DELETE FROM busy", [&](adio::error_code e) { ec = e; });
+    ios.reset();
+    ios.run();
+    CHECK_FALSE(ec);
+}
+
+
+TEST_CASE("Cancel SQLite operations")
+{
+    DECL_OPEN;
+    auto slow = con.prepare(
+        "WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c "
+        "LIMIT 1000000000) SELECT COUNT(*) FROM c");
+    auto queued = con.prepare("SELECT 1");
+    adio::error_code slow_ec, queued_ec;
+    bool queued_ran = false;
+    con.async_step(slow, [&](adio::row, adio::error_code e) { slow_ec = e; });
+    con.async_step(queued, [&](adio::row r, adio::error_code e) {
+        queued_ec = e;
+        queued_ran = r.size() != 0;
+    });
+    con.driver().cancel();
+    ios.run();
+    CHECK(slow_ec == adio::sqlite_errc::interrupt);
+    CHECK(queued_ec == adio::sqlite_errc::interrupt);
+    CHECK_FALSE(queued_ran);
+
+    // Operations started after the cancel run as usual
+    queued.reset();
+    con.async_step(queued, [&](adio::row r, adio::error_code e) {
+        queued_ec = e;
+        queued_ran = r.size() != 0;
+    });
+    ios.reset();
+    ios.run();
+    CHECK_FALSE(queued_ec);
+    CHECK(queued_ran);
+}
+
+
+TEST_CASE("SQLite operation deadlines")
+{
+    DECL_OPEN;
+    auto slow = con.prepare(
+        "WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c "
+        "LIMIT 1000000000) SELECT COUNT(*) FROM c");
+    adio::sqlite_op_options opts;
+    opts.timeout(std::chrono::milliseconds{20});
+    adio::error_code ec;
+    const auto start = std::chrono::steady_clock::now();
+    con.async_step(slow, opts, [&](adio::row, adio::error_code e) { ec = e; });
+    ios.run();
+    CHECK(ec == adio::sqlite_errc::interrupt);
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds{5});
+
+    // An operation past its deadline doesn't run at all
+    con.execute("DROP TABLE IF EXISTS deadline");
+    con.execute("CREATE TABLE deadline (n INTEGER)");
+    auto insert = con.prepare("INSERT INTO deadline VALUES (1)");
+    opts.deadline = std::chrono::steady_clock::now();
+    con.async_execute(insert, opts, [&](adio::error_code e) { ec = e; });
+    ios.reset();
+    ios.run();
+    CHECK(ec == adio::sqlite_errc::interrupt);
+    auto count = con.prepare("SELECT COUNT(*) FROM deadline");
+    std::vector<int> counts{begin(count), end(count)};
+    CHECK(counts == std::vector<int>{0});
+}
+
+
+TEST_CASE("Group commit of async writes")
+{
+    adio::io_service ios;
+    adio::sqlite::connection con{ios};
+    adio::sqlite::connection reader{ios};
+    REQUIRE_FALSE(con.open("group.db"));
+    REQUIRE_FALSE(reader.open("group.db"));
+    con.execute("DROP TABLE IF EXISTS grouped");
+    con.execute("CREATE TABLE grouped (n INTEGER UNIQUE)");
+    con.execute("INSERT INTO grouped VALUES (0)");
+
+    adio::sqlite_group_commit_options group;
+    group.window = std::chrono::seconds{10};
+    group.max_writes = 3;
+    con.driver().set_group_commit(group);
+
+    std::vector<adio::sqlite::statement> inserts;
+    for (auto n : {1, 2, 0, 3})
+    {
+        inserts.push_back(con.prepare("INSERT INTO grouped VALUES (?)"));
+        inserts.back().bind_all(n);
+    }
+    std::vector<adio::error_code> ecs(inserts.size(),
+                                      adio::sqlite_errc::error);
+    int visible_at_first = -1;
+    for (auto i = 0u; i < inserts.size(); ++i)
+    {
+        con.async_execute(inserts[i], [&, i](adio::error_code e) {
+            ecs[i] = e;
+            if (i != 0) return;
+            // The first write completes only once the group has committed
+            auto count = reader.prepare("SELECT COUNT(*) FROM grouped");
+            std::vector<int> counts{begin(count), end(count)};
+            visible_at_first = counts.at(0);
+        });
+    }
+    ios.run();
+    CHECK_FALSE(ecs[0]);
+    CHECK_FALSE(ecs[1]);
+    CHECK(ecs[2] == adio::sqlite_errc::constraint);
+    CHECK_FALSE(ecs[3]);
+    CHECK(visible_at_first == 4);
+
+    // A lone write is committed when the window closes
+    group.window = std::chrono::milliseconds{5};
+    con.driver().set_group_commit(group);
+    auto last = con.prepare("INSERT INTO grouped VALUES (4)");
+    adio::error_code ec = adio::sqlite_errc::error;
+    con.async_execute(last, [&](adio::error_code e) { ec = e; });
+    ios.reset();
+    ios.run();
+    CHECK_FALSE(ec);
+    auto count = reader.prepare("SELECT COUNT(*) FROM grouped");
+    std::vector<int> counts{begin(count), end(count)};
+    CHECK(counts == std::vector<int>{5});
+
+    // Synchronous calls are refused while a group is open, and reads don't
+    // wait for its commit
+    group.window = std::chrono::milliseconds{50};
+    con.driver().set_group_commit(group);
+    last = con.prepare("INSERT INTO grouped VALUES (5)");
+    auto refused = con.prepare("INSERT INTO grouped VALUES (6)");
+    auto read = con.prepare("SELECT 1");
+    ec = adio::sqlite_errc::error;
+    adio::error_code sync_ec;
+    bool read_before_commit = false;
+    con.async_execute(last, [&](adio::error_code e) { ec = e; });
+    // Runs after the write has opened the group, but before it commits
+    con.async_execute(read, [&](adio::error_code) {
+        read_before_commit = ec == adio::sqlite_errc::error;
+        con.execute(refused, sync_ec);
+    });
+    ios.reset();
+    ios.run();
+    CHECK(read_before_commit);
+    CHECK(sync_ec == adio::sys_errc::operation_in_progress);
+    CHECK_FALSE(ec);
+    con.execute(refused, sync_ec);
+    CHECK_FALSE(sync_ec);
+
+    // Closing abandons the open group, and the reopened connection starts
+    // afresh
+    group.window = std::chrono::seconds{10};
+    con.driver().set_group_commit(group);
+    auto abandoned = con.prepare("INSERT INTO grouped VALUES (7)");
+    ec = adio::sqlite_errc::error;
+    con.async_execute(abandoned, [&](adio::error_code e) { ec = e; });
+    con.async_prepare("SELECT 1",
+                      [&](adio::sqlite::statement, adio::error_code) {
+                          con.close();
+                          REQUIRE_FALSE(con.open("group.db"));
+                          con.execute("INSERT INTO grouped VALUES (8)",
+                                      sync_ec);
+                      });
+    ios.reset();
+    ios.run();
+    CHECK(ec == adio::asio::error::operation_aborted);
+    CHECK_FALSE(sync_ec);
+    group.window = std::chrono::milliseconds{5};
+    con.driver().set_group_commit(group);
+    auto regrouped = con.prepare("INSERT INTO grouped VALUES (9)");
+    ec = adio::sqlite_errc::error;
+    con.async_execute(regrouped, [&](adio::error_code e) { ec = e; });
+    ios.reset();
+    ios.run();
+    CHECK_FALSE(ec);
+    auto ns = reader.prepare("SELECT n FROM grouped WHERE n > 6 ORDER BY n");
+    std::vector<int> after_reopen{begin(ns), end(ns)};
+    CHECK((after_reopen == std::vector<int>{8, 9}));
+}
+
+
+TEST_CASE("SQLite transactions")
+{
+    DECL_OPEN;
+    con.execute("DROP TABLE IF EXISTS tx");
+    con.execute("CREATE TABLE tx (n INTEGER)");
+    auto count = [&] {
+        auto st = con.prepare("SELECT COUNT(*) FROM tx");
+        std::vector<int> counts{begin(st), end(st)};
+        return counts.at(0);
+    };
+    {
+        auto tr = con.begin(adio::sqlite_transaction_mode::immediate);
+        CHECK(tr.active());
+        CHECK_FALSE(tr.nested());
+        con.execute("INSERT INTO tx VALUES (1)");
+        // Rolled back when the guard goes out of scope
+    }
+    CHECK(count() == 0);
+
+    auto tr = con.begin();
+    con.execute("INSERT INTO tx VALUES (1)");
+    {
+        auto inner = con.begin();
+        CHECK(inner.nested());
+        con.execute("INSERT INTO tx VALUES (2)");
+        inner.rollback();
+        CHECK_FALSE(inner.active());
+    }
+    {
+        auto inner = con.begin();
+        con.execute("INSERT INTO tx VALUES (3)");
+        auto innermost = con.begin();
+        con.execute("INSERT INTO tx VALUES (4)");
+        innermost.commit();
+        inner.commit();
+    }
+    tr.commit();
+    CHECK_FALSE(tr.active());
+    adio::error_code ec;
+    tr.commit(ec);
+    CHECK(ec);
+    auto st = con.prepare("SELECT n FROM tx ORDER BY n");
+    std::vector<int> ns{begin(st), end(st)};
+    CHECK((ns == std::vector<int>{1, 3, 4}));
+}
+
+
+TEST_CASE("Async SQLite transactions")
+{
+    DECL_OPEN;
+    con.execute("DROP TABLE IF EXISTS tx");
+    con.execute("CREATE TABLE tx (n INTEGER)");
+    auto insert = con.prepare("INSERT INTO tx VALUES (1)");
+    adio::sqlite::transaction tr;
+    adio::error_code ec = adio::sqlite_errc::error;
+    con.async_begin(adio::sqlite_transaction_mode::exclusive,
+                    [&](adio::sqlite::transaction t, adio::error_code e) {
+                        ec = e;
+                        tr = std::move(t);
+                    });
+    ios.run();
+    REQUIRE_FALSE(ec);
+    REQUIRE(tr.active());
+    con.async_execute(insert, [&](adio::error_code e) {
+        REQUIRE_FALSE(e);
+        tr.async_commit([&](adio::error_code e) { ec = e; });
+    });
+    ios.reset();
+    ios.run();
+    CHECK_FALSE(ec);
+    CHECK_FALSE(tr.active());
+    auto st = con.prepare("SELECT COUNT(*) FROM tx");
+    std::vector<int> counts{begin(st), end(st)};
+    CHECK(counts == std::vector<int>{1});
+}
+
+
+TEST_CASE("Back up a SQLite database")
+{
+    DECL_OPEN;
+    con.execute("DROP TABLE IF EXISTS backed_up");
+    con.execute("CREATE TABLE backed_up (n INTEGER, data BLOB)");
+    auto insert = con.prepare("INSERT INTO backed_up VALUES (?, ?)");
+    std::vector<std::tuple<int, adio::value::blob>> rows;
+    for (auto i = 0; i < 100; ++i)
+        rows.emplace_back(i, adio::value::blob(4000, char(i)));
+    con.execute_batch(insert, rows);
+
+    con.backup("backup-sync.db");
+    adio::sqlite::connection copy{ios};
+    REQUIRE_FALSE(copy.open("backup-sync.db"));
+    auto count = copy.prepare("SELECT COUNT(*) FROM backed_up");
+    std::vector<int> counts{begin(count), end(count)};
+    CHECK(counts == std::vector<int>{100});
+
+    adio::sqlite_backup_options opts;
+    opts.pages_per_step = 10;
+    std::vector<adio::sqlite_backup_progress> steps;
+    adio::error_code ec = adio::sqlite_errc::error;
+    con.async_backup(
+        "backup-async.db",
+        opts,
+        [&](adio::sqlite_backup_progress p) { steps.push_back(p); },
+        [&](adio::error_code e) { ec = e; });
+    ios.run();
+    CHECK_FALSE(ec);
+    REQUIRE(steps.size() > 1);
+    CHECK(steps.back().remaining == 0);
+    CHECK(steps.front().total == steps.back().total);
+    CHECK(steps.front().remaining > steps.back().remaining);
+
+    adio::sqlite::connection memory{ios};
+    REQUIRE_FALSE(memory.open(":memory:"));
+    con.async_backup(memory.driver(),
+                     opts,
+                     [](adio::sqlite_backup_progress) {},
+                     [&](adio::error_code e) { ec = e; });
+    ios.reset();
+    ios.run();
+    CHECK_FALSE(ec);
+    auto mem_count = memory.prepare("SELECT COUNT(*) FROM backed_up");
+    std::vector<int> mem_counts{begin(mem_count), end(mem_count)};
+    CHECK(mem_counts == std::vector<int>{100});
+
+    // A destination that stays busy makes the backup give up
+    adio::sqlite::connection locker{ios};
+    REQUIRE_FALSE(locker.open("backup-sync.db"));
+    auto lock = locker.begin(adio::sqlite_transaction_mode::exclusive);
+    opts.busy_delay = std::chrono::milliseconds{1};
+    opts.max_busy_retries = 3;
+    con.backup("backup-sync.db", opts, ec);
+    CHECK(ec == adio::sqlite_errc::busy);
+    ec = {};
+    con.async_backup("backup-sync.db",
+                     opts,
+                     [](adio::sqlite_backup_progress) {},
+                     [&](adio::error_code e) { ec = e; });
+    ios.reset();
+    ios.run();
+    CHECK(ec == adio::sqlite_errc::busy);
+    lock.rollback();
+}
+
+
+TEST_CASE("Stream SQLite blobs")
+{
+    DECL_OPEN;
+    con.execute("DROP TABLE IF EXISTS blobs");
+    con.execute("CREATE TABLE blobs (data BLOB)");
+    con.execute("INSERT INTO blobs VALUES (zeroblob(100000))");
+    auto rowids = con.prepare("SELECT rowid FROM blobs");
+    const std::int64_t rowid = std::vector<int>{begin(rowids), end(rowids)}[0];
+
+    std::vector<char> payload(100000);
+    for (auto i = 0u; i < payload.size(); ++i) payload[i] = char(i % 251);
+
+    adio::sqlite_blob blob{con};
+    CHECK_FALSE(blob.is_open());
+    blob.open("blobs", "data", rowid, adio::sqlite_blob_access::read_write);
+    CHECK(blob.size() == payload.size());
+    adio::asio::write(blob, adio::asio::buffer(payload));
+    CHECK(blob.tell() == payload.size());
+    adio::error_code ec;
+    char extra = 0;
+    blob.write_some(adio::asio::buffer(&extra, 1), ec);
+    CHECK(ec == adio::sys_errc::file_too_large);
+
+    // Read it back in chunks, on the connection's lane
+    blob.seek(0);
+    std::vector<char> read_back;
+    std::array<char, 4096> chunk;
+    std::function<void(adio::error_code, std::size_t)> on_read
+        = [&](adio::error_code e, std::size_t n) {
+              const auto data = chunk.begin();
+              read_back.insert(read_back.end(), data, data + n);
+              if (e)
+              {
+                  ec = e;
+                  return;
+              }
+              blob.async_read_some(adio::asio::buffer(chunk), on_read);
+          };
+    blob.async_read_some(adio::asio::buffer(chunk), on_read);
+    ios.run();
+    CHECK(ec == adio::asio::error::eof);
+    CHECK(read_back == payload);
+
+    blob.seek(0);
+    std::vector<char> sync_read(payload.size());
+    adio::asio::read(blob, adio::asio::buffer(sync_read));
+    CHECK(sync_read == payload);
+    CHECK(blob.read_some(adio::asio::buffer(chunk), ec) == 0);
+    CHECK(ec == adio::asio::error::eof);
+
+    blob.close();
+    CHECK_FALSE(blob.is_open());
+    blob.open(
+        "blobs", "data", rowid + 1, adio::sqlite_blob_access::read_only, ec);
+    CHECK(ec);
+
+    // Open in a named database, and close on the lane when destroyed
+    {
+        adio::sqlite_blob async_blob{con};
+        ec = adio::sqlite_errc::error;
+        async_blob.async_open("blobs",
+                              "data",
+                              rowid,
+                              adio::sqlite_blob_access::read_only,
+                              "main",
+                              [&](adio::error_code e) { ec = e; });
+        ios.reset();
+        ios.run();
+        CHECK_FALSE(ec);
+        CHECK(async_blob.is_open());
+        async_blob.async_open("blobs",
+                              "data",
+                              rowid,
+                              adio::sqlite_blob_access::read_only,
+                              "nonexistent",
+                              [&](adio::error_code e) { ec = e; });
+        ios.reset();
+        ios.run();
+        CHECK(ec);
+        async_blob.async_open("blobs",
+                              "data",
+                              rowid,
+                              adio::sqlite_blob_access::read_only,
+                              [&](adio::error_code e) { ec = e; });
+        ios.reset();
+        ios.run();
+        CHECK_FALSE(ec);
+    }
+    // The blob was closed on the lane, so the table can be dropped
+    ec = adio::sqlite_errc::error;
+    con.async_execute("DROP TABLE blobs", [&](adio::error_code e) { ec = e; });
+    ios.reset();
+    ios.run();
+    CHECK_FALSE(ec);
+}
+
+
+TEST_CASE("SQLite statement statistics")
+{
+    DECL_OPEN;
+    con.driver().set_statement_stats_enabled(true);
+    con.execute("DROP TABLE IF EXISTS scanned");
+    con.execute("CREATE TABLE scanned (n INTEGER)");
+    auto insert = con.prepare("INSERT INTO scanned VALUES (?)");
+    std::vector<std::tuple<int>> rows;
+    for (auto i = 0; i < 50; ++i) rows.emplace_back(50 - i);
+    con.execute_batch(insert, rows);
+    CHECK(insert.stats().runs == 50);
+
+    const std::string sql = "SELECT n FROM scanned ORDER BY n";
+    for (auto i = 0; i < 2; ++i)
+    {
+        auto st = con.prepare(sql);
+        std::vector<int> ns{begin(st), end(st)};
+        REQUIRE(ns.size() == 50);
+        const auto stats = st.stats();
+        CHECK(stats.runs == 1);
+        CHECK(stats.fullscan_steps == 49);
+        CHECK(stats.sorts == 1);
+        CHECK(stats.step_time.count() > 0);
+    }
+
+    const auto totals = con.driver().statement_stats();
+    const auto it = std::find_if(
+        totals.begin(),
+        totals.end(),
+        [&](const std::pair<std::string, adio::sqlite_statement_stats>& p) {
+            return p.first == sql;
+        });
+    REQUIRE(it != totals.end());
+    CHECK(it->second.runs == 2);
+    CHECK(it->second.sorts == 2);
+    CHECK(it->second.fullscan_steps == 98);
+
+    con.driver().set_statement_stats_enabled(false);
+    CHECK(con.driver().statement_stats().empty());
+}
+
+
+TEST_CASE("Trace SQLite statements")
+{
+    DECL_OPEN;
+    auto& driver = con.driver();
+    auto ring = std::make_shared<adio::sqlite_trace_ring_buffer>(4);
+    adio::sqlite_trace_options opts;
+    opts.sink = ring;
+    driver.set_trace(opts);
+
+    con.execute("DROP TABLE IF EXISTS traced");
+    con.execute("CREATE TABLE traced (n INTEGER)");
+    auto insert = con.prepare("INSERT INTO traced VALUES (?)");
+    for (auto i = 0; i < 3; ++i)
+    {
+        insert.reset();
+        insert.bind(1, adio::value{adio::value::integer{40 + i}});
+        con.execute(insert);
+    }
+    auto events = ring->events();
+    CHECK(ring->recorded() == 5);
+    REQUIRE(events.size() == 4);
+    CHECK(events[0].sql == "CREATE TABLE traced (n INTEGER)");
+    CHECK(events[3].connection == &driver);
+    CHECK(events[3].sql == "INSERT INTO traced VALUES (42)");
+    CHECK(events[3].finished >= events[0].finished);
+
+    SECTION("Slow statements only")
+    {
+        std::vector<std::string> slow;
+        opts.sink = std::make_shared<adio::sqlite_trace_callback>(
+            [&](const adio::sqlite_trace_event& ev) {
+                slow.push_back(ev.sql);
+            });
+        opts.threshold = std::chrono::hours{1};
+        driver.set_trace(opts);
+        con.execute("SELECT count(*) FROM traced");
+        CHECK(slow.empty());
+        opts.threshold = std::chrono::nanoseconds{0};
+        driver.set_trace(opts);
+        con.execute("SELECT count(*) FROM traced");
+        CHECK(slow == std::vector<std::string>{"SELECT count(*) FROM traced"});
+    }
+
+    SECTION("Events name a connection after it is moved")
+    {
+        auto& service = adio::asio::use_service<adio::sqlite::service>(ios);
+        adio::sqlite original{service};
+        original.set_trace(opts);
+        REQUIRE_FALSE(original.open(":memory:"));
+        adio::sqlite moved{std::move(original)};
+        moved.execute("SELECT 1");
+        CHECK(ring->events().back().connection == &moved);
+        adio::sqlite assigned{service};
+        assigned = std::move(moved);
+        assigned.execute("SELECT 2");
+        CHECK(ring->events().back().connection == &assigned);
+    }
+
+    SECTION("Disable the trace")
+    {
+        driver.set_trace(boost::none);
+        con.execute("SELECT count(*) FROM traced");
+        CHECK(ring->recorded() == 5);
+    }
+
+    SECTION("Write the trace to a file")
+    {
+        const std::string path = "adio_trace_test.log";
+        std::remove(path.data());
+        {
+            opts.sink = std::make_shared<adio::sqlite_trace_file>(path);
+            driver.set_trace(opts);
+            con.execute("SELECT 1\nUNION ALL SELECT 2");
+            driver.set_trace(boost::none);
+            opts.sink.reset();
+        }
+        std::ifstream in{path};
+        std::string line;
+        REQUIRE(std::getline(in, line));
+        CHECK(line.find("\tSELECT 1 UNION ALL SELECT 2") != std::string::npos);
+        CHECK_FALSE(std::getline(in, line));
+        in.close();
+        std::remove(path.data());
+    }
+}
+
+
+TEST_CASE("SQLite service metrics")
+{
+    DECL_CON;
+    auto& service = adio::asio::use_service<adio::sqlite::service>(ios);
+    service.reset_metrics();
+    service.set_metrics_enabled(true);
+
+    std::size_t done = 0;
+    con.async_open("foo.db", [&](adio::error_code ec) {
+        REQUIRE_FALSE(ec);
+        con.async_prepare(
+            "SELECT 1", [&](adio::sqlite::statement st, adio::error_code ec) {
+                REQUIRE_FALSE(ec);
+                auto shared = std::make_shared<adio::sqlite::statement>(
+                    std::move(st));
+                con.async_step(*shared, [&, shared](adio::sqlite::row,
+                                                    adio::error_code ec) {
+                    CHECK_FALSE(ec);
+                    con.async_execute("SELECT 2", [&](adio::error_code ec) {
+                        CHECK_FALSE(ec);
+                        ++done;
+                    });
+                });
+            });
+    });
+    ios.run();
+    REQUIRE(done == 1);
+    service.set_metrics_enabled(false);
+
+    // The last task is counted after its handler has been posted
+    auto metrics = service.metrics();
+    for (auto i = 0; i < 1000 && metrics.busy_workers != 0; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+        metrics = service.metrics();
+    }
+    CHECK(metrics.queue_depth == 0);
+    CHECK(metrics.busy_workers == 0);
+    CHECK(metrics.threads > 0);
+    using kind = adio::sqlite_op_kind;
+    CHECK(metrics[kind::open].latency.count() == 1);
+    // Executing SQL text prepares it first
+    CHECK(metrics[kind::prepare].run_time.count() == 2);
+    CHECK(metrics[kind::step].queue_wait.count() == 1);
+    CHECK(metrics[kind::execute].latency.count() == 1);
+    CHECK(metrics[kind::other].latency.count() == 0);
+    CHECK(metrics[kind::open].run_time.sum().count() > 0);
+    CHECK(metrics[kind::open].latency.max()
+          >= metrics[kind::open].run_time.max());
+
+    const auto text = metrics.to_prometheus();
+    CHECK(text.find("# TYPE adio_sqlite_queue_depth gauge\n"
+                    "adio_sqlite_queue_depth 0\n")
+          != std::string::npos);
+    CHECK(text.find("adio_sqlite_run_seconds_count{op=\"open\"} 1\n")
+          != std::string::npos);
+    CHECK(text.find("adio_sqlite_latency_seconds{op=\"step\",quantile="
+                    "\"0.99\"} ")
+          != std::string::npos);
+
+    // Nothing is recorded while disabled
+    con.execute("SELECT 3");
+    con.async_execute("SELECT 3", [](adio::error_code) {});
+    ios.reset();
+    ios.run();
+    CHECK(service.metrics()[kind::execute].latency.count() == 1);
+    service.reset_metrics();
+    CHECK(service.metrics()[kind::open].latency.count() == 0);
+}
+
+
+TEST_CASE("Timeline of async SQLite operations")
+{
+    DECL_CON;
+    auto& service = adio::asio::use_service<adio::sqlite::service>(ios);
+    auto tl = std::make_shared<adio::timeline>();
+    service.set_timeline(tl);
+
+    auto done = false;
+    con.async_open("foo.db", [&](adio::error_code ec) {
+        CHECK_FALSE(ec);
+        done = true;
+    });
+    ios.run();
+    REQUIRE(done);
+    service.set_timeline(nullptr);
+
+    // The run of the task is recorded after its handler has been posted
+    auto spans = tl->spans();
+    for (auto i = 0; i < 1000 && spans.size() < 5; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+        spans = tl->spans();
+    }
+    REQUIRE(spans.size() == 5);
+    std::map<std::string, adio::timeline_span> by_name;
+    for (const auto& span : spans)
+    {
+        CHECK(span.id == spans[0].id);
+        CHECK(span.end >= span.start);
+        by_name[span.name] = span;
+    }
+    const auto me = adio::timeline::this_thread_id();
+    CHECK(by_name.at("open: call").thread == me);
+    CHECK(by_name.at("open: queued").thread == 0);
+    CHECK(by_name.at("open: run").thread != me);
+    CHECK(by_name.at("open: run").start >= by_name.at("open: queued").end);
+    CHECK(by_name.at("open: handler queued").thread == 0);
+    CHECK(by_name.at("open: handler").thread == me);
+    CHECK(by_name.at("open: handler").start
+          >= by_name.at("open: handler queued").end);
+
+    std::ostringstream out;
+    tl->write_chrome_json(out);
+    CHECK(out.str().find("\"name\":\"open: run\"") != std::string::npos);
+
+    // Nothing is recorded once the timeline is removed
+    tl->clear();
+    con.async_execute("SELECT 1", [](adio::error_code) {});
+    ios.reset();
+    ios.run();
+    CHECK(tl->spans().empty());
+}
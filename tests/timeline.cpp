@@ -0,0 +1,57 @@
+#include <catch/catch.hpp>
+
+#include <adio/timeline.hpp>
+
+#include <sstream>
+#include <thread>
+
+
+TEST_CASE("Record a timeline")
+{
+    using clock = adio::timeline::clock;
+    adio::timeline tl{3};
+    const auto id = tl.new_id();
+    CHECK(tl.new_id() != id);
+
+    const auto t0 = clock::now();
+    const auto tid = adio::timeline::this_thread_id();
+    std::uint64_t other_tid = 0;
+    std::thread{[&] { other_tid = adio::timeline::this_thread_id(); }}.join();
+    CHECK(other_tid != tid);
+    CHECK(adio::timeline::this_thread_id() == tid);
+
+    tl.record({"call", id, tid, t0, t0 + std::chrono::microseconds{2}});
+    tl.record({"queued \"x\"", id, 0, t0, t0 + std::chrono::microseconds{5}});
+    tl.record({"run",
+               id,
+               other_tid,
+               t0 + std::chrono::microseconds{5},
+               t0 + std::chrono::microseconds{9}});
+    tl.record({"dropped", id, tid, t0, t0});
+    CHECK(tl.spans().size() == 3);
+    CHECK(tl.dropped() == 1);
+
+    std::ostringstream out;
+    tl.write_chrome_json(out);
+    const auto json = out.str();
+    CHECK(json.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[") == 0);
+    CHECK(json.find("\"name\":\"call\",\"cat\":\"adio\",\"ph\":\"X\"")
+          != std::string::npos);
+    CHECK(json.find("\"name\":\"queued \\\"x\\\"\",\"cat\":\"adio\",\"ph\":"
+                    "\"b\"")
+          != std::string::npos);
+    CHECK(json.find("\"ph\":\"e\"") != std::string::npos);
+    // A flow connects the call to the run
+    CHECK(json.find("\"ph\":\"s\",\"pid\":1,\"tid\":" + std::to_string(tid))
+          != std::string::npos);
+    CHECK(json.find("\"ph\":\"f\",\"pid\":1,\"tid\":"
+                    + std::to_string(other_tid))
+          != std::string::npos);
+    CHECK(json.find("\"bp\":\"e\"") != std::string::npos);
+    CHECK(json.find("\"dur\":4.000") != std::string::npos);
+    CHECK(json.find("dropped") == std::string::npos);
+
+    tl.clear();
+    CHECK(tl.spans().empty());
+    CHECK(tl.dropped() == 0);
+}